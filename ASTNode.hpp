@@ -1,15 +1,20 @@
 #pragma once
 
 #include <cmath>
-#include <sstream>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "Governor.hpp"
+#include "Image.hpp"
+#include "Numeric.hpp"
+#include "Output.hpp"
 #include "SymbolTable.hpp"
+#include "TokenBuffer.hpp"
 #include "lexer.hpp"
 #include "Utils.hpp"
 
-enum Type {
+enum Type : uint8_t {
   ASSIGNMENT,        // Variable assignment (left = variable, right = expression)
   VARIABLE,          // Variable node
   NUMBER,            // Numeric literal
@@ -24,120 +29,302 @@ enum Type {
   WHILE_LOOP         // While loops
 };
 
-class ASTNode {
-private:
+constexpr size_t NUM_TYPES = WHILE_LOOP + 1;
+
+inline const char* TypeName(Type type) {
+  static constexpr const char* names[NUM_TYPES] = {
+    "ASSIGNMENT", "VARIABLE", "NUMBER", "BINARY_OPERATION", "UNARY_OPERATION", "UPDATE",
+    "STATEMENT_BLOCK", "PRINT", "STRING", "IF_STATEMENT", "ELSE_STATEMENT", "WHILE_LOOP"};
+  return names[type];
+}
+
+// Nodes refer to each other by their index in the owning AST
+using NodeId = uint32_t;
+constexpr NodeId NO_NODE = UINT32_MAX;
+
+// Compact AST node; the payload that is valid depends on 'type'.
+struct ASTNode {
   Type type;
-  emplex::Token token;
-  int var_unique_id;
-  double value = 0;
-  std::string lexeme;
-  ASTNode* left = nullptr;
-  ASTNode* right = nullptr;
-  ASTNode* elseBlock = nullptr; // optional 3rd child for 'if' nodes
-  std::vector<ASTNode*> blockStatements;
-  std::vector<std::pair<int, int>> variableEntries; // first pair.first - index in string, pair.second - unique id
+  uint8_t op = 0;     // Operator token id (BINARY_OPERATION / UNARY_OPERATION)
+  bool integer_operands = false; // % and **: both operands proven integer-valued by the Optimizer
+  uint32_t token = 0; // Index of the token this node came from, for error reporting
+  union {
+    double value;                                    // NUMBER
+    int var;                                         // VARIABLE
+    struct { int var; NodeId value; } assign;        // ASSIGNMENT (value may be NO_NODE)
+    struct { NodeId left, right; } binary;           // BINARY_OPERATION, UNARY_OPERATION (left)
+    NodeId child;                                    // PRINT, ELSE_STATEMENT
+    struct { NodeId cond, body, else_body; } branch; // IF_STATEMENT, WHILE_LOOP
+    struct { uint32_t first, count; } block;         // STATEMENT_BLOCK: range in AST::lists
+    uint32_t string;                                 // STRING: index in AST::strings
+  };
+
+  ASTNode(Type type, uint32_t token) : type(type), token(token), branch{NO_NODE, NO_NODE, NO_NODE} {}
+  ASTNode() : ASTNode(NUMBER, 0) {} // Placeholder to be overwritten (loading an image)
+};
+
+// A literal piece of an interpolated string, followed by a variable (or -1).
+// Variable unique ids are also their SymbolTable slots.
+struct StringSegment {
+  std::string literal;
+  int slot = -1;
+};
+
+// String literal, split into segments when it is parsed
+struct StringLiteral {
+  std::vector<StringSegment> segments;
+};
+
+// Arena that owns every node of a program; all nodes are released together.
+class AST {
+private:
+  std::vector<ASTNode> nodes;
+  std::vector<NodeId> lists;           // Statement lists of STATEMENT_BLOCK nodes
+  std::vector<StringLiteral> strings;  // Payloads of STRING nodes
+  size_t segment_bytes = 0;            // Held by the segments of 'strings'
+  TokenBuffer& tokens;     // Lexed again on demand when the AST came from an image
+  std::string_view source; // Source the tokens view, for locating errors
+  Output& out;             // Where PRINT writes
+  uint64_t* executed = nullptr; // Per-Type execution counts for Run<true>
+  Governor* governor = nullptr; // Limits of the current run, if it has any
+
+  static size_t SegmentBytes(const StringLiteral& literal) {
+    size_t bytes = literal.segments.capacity() * sizeof(StringSegment);
+    for (const StringSegment& segment : literal.segments) bytes += segment.literal.capacity();
+    return bytes;
+  }
+
+  NodeId Add(const ASTNode& node) {
+    nodes.push_back(node);
+    return static_cast<NodeId>(nodes.size() - 1);
+  }
 
 public:
-  // Constructor for STRING nodes
-  ASTNode(Type type, const std::string& string_val) : type(type), lexeme(string_val) {}
-  ASTNode(Type type, const std::string& string_val, std::vector<std::pair<int,int>> entries) : type(type), lexeme(string_val) {
-    this->variableEntries = entries;
+  AST(TokenBuffer& tokens, std::string_view source, Output& out)
+    : tokens(tokens), source(source), out(out) {}
+
+  const ASTNode& operator[](NodeId id) const { return nodes[id]; }
+  ASTNode& operator[](NodeId id) { return nodes[id]; } // For in-place rewriting passes
+  size_t size() const { return nodes.size(); }
+
+  const emplex::Token& GetToken(NodeId id) const {
+    tokens.Has(nodes[id].token);
+    return tokens.At(nodes[id].token);
   }
+  std::string_view GetSource() const { return source; }
 
-  // Constructor for other types
-  ASTNode(Type type) : type(type) {}
+  // Report an error at the token a node came from
+  [[noreturn]] void Error(const std::string& message, NodeId id) const { Utils::error(message, GetToken(id), source); }
+  const StringLiteral& GetString(NodeId id) const { return strings[nodes[id].string]; }
+  const NodeId* BlockBegin(NodeId id) const { return lists.data() + nodes[id].block.first; }
+  const NodeId* BlockEnd(NodeId id) const { return BlockBegin(id) + nodes[id].block.count; }
+  NodeId* BlockBegin(NodeId id) { return lists.data() + nodes[id].block.first; }
+  NodeId* BlockEnd(NodeId id) { return BlockBegin(id) + nodes[id].block.count; }
 
-  // Constructor with token
-  ASTNode(Type type, emplex::Token token) : ASTNode(type) { this->token = token; }
+  // Bytes currently allocated for nodes, block lists and strings
+  size_t Bytes() const {
+    return nodes.capacity() * sizeof(ASTNode) + lists.capacity() * sizeof(NodeId)
+         + strings.capacity() * sizeof(StringLiteral) + segment_bytes;
+  }
 
-  // Constructor for NUMBER or VARIABLE nodes
-  ASTNode(Type type, double value) : ASTNode(type) {
-    if (type == Type::VARIABLE) var_unique_id = static_cast<int>(value);
-    else this->value = value;
+  // Add the number of nodes of each Type to 'counts' (NUM_TYPES entries)
+  void CountTypes(uint64_t* counts) const {
+    for (const ASTNode& node : nodes) ++counts[node.type];
   }
 
-  // Set block statements for a block node
-  void SetBlockStatements(std::vector<ASTNode*> blockStatements) { this->blockStatements = blockStatements; }
+  // Where Run<true> counts executed nodes by Type (NUM_TYPES entries)
+  void SetExecutionCounts(uint64_t* counts) { executed = counts; }
 
-  // Set left and right child nodes
-  void SetLeft(ASTNode* node) { left = node; }
-  void SetRight(ASTNode* node) { right = node; }
-  void SetElseBlock(ASTNode* node) { elseBlock = node; }
+  // Limits every engine counts loop iterations against (null: none, and no counting)
+  void SetGovernor(Governor* limits) { governor = limits; }
+  Governor* GetGovernor() const { return governor; }
 
-  // Main run function to evaluate the ASTNode
-  double Run(SymbolTable& symbols) { 
-    double lvalue = 0, rvalue = 0;
-    int unique_id;
+  // Count an iteration of the while loop 'id'; only when GetGovernor() is set
+  void Step(NodeId id) const {
+    if (--governor->countdown == 0) CheckLimits(id);
+  }
 
-    switch (type) {
-      case NUMBER:
-        return value;
+  // The Governor's slow path, failing at the loop 'id' if the run is over a limit
+  void CheckLimits(NodeId id) const { governor->Check(GetToken(id), source); }
+
+  // Append every node, block list and string to 'image', for Load()
+  void Save(ImageWriter& image) const {
+    image.PutArray(nodes);
+    image.PutArray(lists);
+    image.Put<uint64_t>(strings.size());
+    for (const StringLiteral& literal : strings) {
+      image.Put<uint64_t>(literal.segments.size());
+      for (const StringSegment& segment : literal.segments) {
+        image.PutString(segment.literal);
+        image.Put<int32_t>(segment.slot);
+      }
+    }
+  }
+
+  // Replace the whole arena with one written by Save(); false if 'image' is cut short.
+  bool Load(ImageReader& image) {
+    uint64_t count;
+    if (!image.GetArray(nodes) || !image.GetArray(lists) || !image.GetCount(count)) return false;
+    strings.assign(count, {});
+    segment_bytes = 0;
+    for (StringLiteral& literal : strings) {
+      if (!image.GetCount(count)) return false;
+      literal.segments.resize(count);
+      for (StringSegment& segment : literal.segments) {
+        int32_t slot;
+        if (!image.GetString(segment.literal) || !image.Get(slot)) return false;
+        segment.slot = slot;
+      }
+      segment_bytes += SegmentBytes(literal);
+    }
+    return true;
+  }
+
+  // Release every node at once (streaming execution reuses the arena per statement)
+  void Clear() {
+    nodes.clear();
+    lists.clear();
+    strings.clear();
+    segment_bytes = 0;
+  }
+
+  // Node constructors; 'token' is the index of the token that introduced the node
+  NodeId AddNumber(double value, uint32_t token) {
+    ASTNode node(NUMBER, token);
+    node.value = value;
+    return Add(node);
+  }
+
+  NodeId AddVariable(int unique_id, uint32_t token) {
+    ASTNode node(VARIABLE, token);
+    node.var = unique_id;
+    return Add(node);
+  }
 
-      case STRING: {
-        std::ostringstream result;
-        int var_index = 0, i = 0;
+  NodeId AddAssignment(int unique_id, NodeId value, uint32_t token) {
+    ASTNode node(ASSIGNMENT, token);
+    node.assign = {unique_id, value};
+    return Add(node);
+  }
 
-        // move through a string character-by-character
-        while (var_index < variableEntries.size() || i < lexeme.length()) {
+  NodeId AddUnary(NodeId operand, uint32_t token) {
+    ASTNode node(UNARY_OPERATION, token);
+    node.op = static_cast<uint8_t>(tokens.At(token).id);
+    node.binary = {operand, NO_NODE};
+    return Add(node);
+  }
+
+  NodeId AddBinary(NodeId left, NodeId right, uint32_t token) {
+    ASTNode node(BINARY_OPERATION, token);
+    node.op = static_cast<uint8_t>(tokens.At(token).id);
+    node.binary = {left, right};
+    return Add(node);
+  }
+
+  NodeId AddPrint(NodeId value, uint32_t token) {
+    ASTNode node(PRINT, token);
+    node.child = value;
+    return Add(node);
+  }
+
+  NodeId AddString(std::vector<StringSegment> segments, uint32_t token) {
+    ASTNode node(STRING, token);
+    node.string = static_cast<uint32_t>(strings.size());
+    strings.push_back({std::move(segments)});
+    segment_bytes += SegmentBytes(strings.back());
+    return Add(node);
+  }
 
-          // if current index = index of a variable, look it up in a symbol table and append to the output
-          if (var_index < variableEntries.size() && i == variableEntries[var_index].first) {
-            result << symbols.GetValue(variableEntries[var_index++].second);  
-          } else  {
-            result << lexeme[i++];  
-          }
+  NodeId AddBlock(const std::vector<NodeId>& statements, uint32_t token) {
+    ASTNode node(STATEMENT_BLOCK, token);
+    node.block = {static_cast<uint32_t>(lists.size()), static_cast<uint32_t>(statements.size())};
+    lists.insert(lists.end(), statements.begin(), statements.end());
+    return Add(node);
+  }
+
+  NodeId AddIf(NodeId cond, NodeId body, NodeId else_body, uint32_t token) {
+    ASTNode node(IF_STATEMENT, token);
+    node.branch = {cond, body, else_body};
+    return Add(node);
+  }
+
+  // A copy of an existing node, sharing its children (for rewriting passes)
+  NodeId AddCopy(NodeId id) {
+    ASTNode node = nodes[id];
+    return Add(node);
+  }
+
+  NodeId AddWhile(NodeId cond, NodeId body, uint32_t token) {
+    ASTNode node(WHILE_LOOP, token);
+    node.branch = {cond, body, NO_NODE};
+    return Add(node);
+  }
+
+  // Main run function to evaluate a node; Run<true> also counts every node it runs
+  template <bool COUNT = false>
+  double Run(NodeId id, SymbolTable& symbols) const {
+    const ASTNode& node = nodes[id];
+    double lvalue = 0, rvalue = 0;
+    if constexpr (COUNT) ++executed[node.type];
+
+    switch (node.type) {
+      case NUMBER:
+        return node.value;
+
+      case STRING:
+        for (const StringSegment& segment : strings[node.string].segments) {
+          out.Write(segment.literal);
+          if (segment.slot >= 0) out.WriteNumber(symbols.Slot(segment.slot));
         }
-        std::cout << result.str() << "\n";
+        out.Put('\n');
         return 0;
-      }
 
       case VARIABLE:
-        return symbols.GetValue(var_unique_id);
+        return symbols.Slot(node.var);
 
       case ASSIGNMENT:
-        unique_id = left->var_unique_id;
-        if (right != nullptr) {
-          rvalue = right->Run(symbols);
+        if (node.assign.value != NO_NODE) {
+          rvalue = Run<COUNT>(node.assign.value, symbols);
         }
-        symbols.UpdateVar(unique_id, rvalue);
+        symbols.Slot(node.assign.var) = rvalue;
         return rvalue;
 
       case UNARY_OPERATION:
-        value = left->Run(symbols);
-        if (token.id == emplex::Lexer::ID_negation)
-          return -value;
-        else if (token.id == emplex::Lexer::ID_not)
-          return value == 0 ? 1 : 0;
-        Utils::error("Expected unary operation", token);
+        lvalue = Run<COUNT>(node.binary.left, symbols);
+        if (node.op == emplex::Lexer::ID_negation)
+          return -lvalue;
+        else if (node.op == emplex::Lexer::ID_not)
+          return lvalue == 0 ? 1 : 0;
+        Error("Expected unary operation", id);
         return 0;
 
       case BINARY_OPERATION:
-        lvalue = left->Run(symbols);
-        if (token.id == emplex::Lexer::ID_and)
-          return (lvalue != 0) && (right->Run(symbols) != 0) ? 1 : 0;
-        if (token.id == emplex::Lexer::ID_or)
-          return (lvalue != 0) || (right->Run(symbols) != 0) ? 1 : 0;
-
-        rvalue = right->Run(symbols);
-        switch (token.id) {
+        lvalue = Run<COUNT>(node.binary.left, symbols);
+        if (node.op == emplex::Lexer::ID_and)
+          return (lvalue != 0) && (Run<COUNT>(node.binary.right, symbols) != 0) ? 1 : 0;
+        if (node.op == emplex::Lexer::ID_or)
+          return (lvalue != 0) || (Run<COUNT>(node.binary.right, symbols) != 0) ? 1 : 0;
+
+        rvalue = Run<COUNT>(node.binary.right, symbols);
+        switch (node.op) {
           case emplex::Lexer::ID_add:
-            return lvalue + rvalue;
+            return Sum(lvalue, rvalue);
           case emplex::Lexer::ID_negation:
             return lvalue - rvalue;
           case emplex::Lexer::ID_multiply:
-            return lvalue * rvalue;
+            return Product(lvalue, rvalue);
           case emplex::Lexer::ID_divide:
-            if (rvalue == 0) Utils::error("Division by zero", token);
+            if (rvalue == 0) Error("Division by zero", id);
             return lvalue / rvalue;
           case emplex::Lexer::ID_modulus:
-          {
-            int lvalue_int = round(lvalue);
-            int rvalue_int = round(rvalue);
-            auto result = lvalue_int % rvalue_int;
-            return (double)result;
-          }
+            if (!node.integer_operands) {
+              lvalue = round(lvalue);
+              rvalue = round(rvalue);
+            }
+            if (rvalue == 0) Error("Modulus by zero", id);
+            return IntegerModulus(lvalue, rvalue);
           case emplex::Lexer::ID_exponent:
-            return pow(lvalue, rvalue);
+            return node.integer_operands ? IntegerPower(lvalue, rvalue) : pow(lvalue, rvalue);
           case emplex::Lexer::ID_equality:
             return lvalue == rvalue ? 1 : 0;
           case emplex::Lexer::ID_not_eq:
@@ -151,50 +338,52 @@ public:
           case emplex::Lexer::ID_less_or_eq:
             return lvalue <= rvalue ? 1 : 0;
           default:
-            Utils::error("Unknown binary operation", token);
+            Error("Unknown binary operation", id);
         }
 
       case PRINT:
-        lvalue = left->Run(symbols);
-        if (left->type != STRING) {
-          std::cout << lvalue << std::endl;
+        lvalue = Run<COUNT>(node.child, symbols);
+        if (nodes[node.child].type != STRING) {
+          out.WriteNumber(lvalue);
+          out.Put('\n');
         }
         return 0;
 
       case STATEMENT_BLOCK:
-        for (ASTNode* statement : blockStatements) {
-          statement->Run(symbols);
+        for (const NodeId* it = BlockBegin(id); it != BlockEnd(id); ++it) {
+          Run<COUNT>(*it, symbols);
         }
         return 0;
 
       case IF_STATEMENT:
-        lvalue = left->Run(symbols);
+        lvalue = Run<COUNT>(node.branch.cond, symbols);
 
         if (lvalue != 0) {
-          rvalue = right->Run(symbols);
+          rvalue = Run<COUNT>(node.branch.body, symbols);
         }
-        else if (elseBlock != nullptr) {
-          elseBlock->Run(symbols);
+        else if (node.branch.else_body != NO_NODE) {
+          Run<COUNT>(node.branch.else_body, symbols);
         }
 
         return 0;
 
       case ELSE_STATEMENT:
-        rvalue = right->Run(symbols);
+        rvalue = Run<COUNT>(node.child, symbols);
         return 0;
 
       case WHILE_LOOP:
-        lvalue = left->Run(symbols);
+        lvalue = Run<COUNT>(node.branch.cond, symbols);
 
         while (lvalue != 0) {
-          rvalue = right->Run(symbols);
-          lvalue = left->Run(symbols);
+          if (governor) Step(id);
+          rvalue = Run<COUNT>(node.branch.body, symbols);
+          lvalue = Run<COUNT>(node.branch.cond, symbols);
         }
 
         return 0;
 
       default:
-        Utils::error("Unknown node type encountered during execution", token);
+        Error("Unknown node type encountered during execution", id);
     }
 
     return 0;
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Output.hpp"
+#include "Parser.hpp"
+#include "SourceFile.hpp"
+#include "Utils.hpp"
+
+// What one script of a batch produced
+struct ScriptResult {
+  std::string output;   // Everything it printed
+  std::string error;    // Error message that stopped it, if any
+  int status = 0;       // Exit status it would have had when run on its own
+};
+
+// Run one script with its own Parser (and so SymbolTable and AST) and output buffer.
+inline ScriptResult RunScript(const std::string& filename, const RunOptions& options) {
+  ScriptResult result;
+  SourceFile source;
+  if (!source.Open(filename)) {
+    result.output = "ERROR: Unable to open file '" + filename + "'.\n";
+    result.status = 1;
+    return result;
+  }
+  Output out(result.output);
+  try {
+    Parser parser(source.Text(), out);
+    parser.Parse(options);
+  } catch (const ScriptError& error) {
+    result.error = error.what();
+    result.status = ExitStatus(error);
+  }
+  out.Flush();
+  return result;
+}
+
+// Task indices spread over one deque per worker.  A worker takes tasks from the
+// front of its own deque and, once that is empty, steals from the back of the
+// others', so a few slow scripts do not leave the other cores idle.  Tasks are
+// dealt round robin, so they tend to finish in input order.
+class WorkQueues {
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+  std::vector<Queue> queues;
+
+public:
+  WorkQueues(size_t workers, size_t count) : queues(workers) {
+    for (size_t task = 0; task < count; ++task) queues[task % workers].tasks.push_back(task);
+  }
+
+  // Next task for 'worker'; false once every queue is empty (none are added later).
+  bool Next(size_t worker, size_t& task) {
+    for (size_t k = 0; k < queues.size(); ++k) {
+      Queue& queue = queues[(worker + k) % queues.size()];
+      std::lock_guard<std::mutex> hold(queue.lock);
+      if (queue.tasks.empty()) continue;
+      if (k == 0) {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      } else {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+      return true;
+    }
+    return false;
+  }
+};
+
+// Run every script in 'filenames' on 'jobs' threads.  Each script's output goes
+// to 'out' and its error message to 'errors' in input order, as soon as the
+// scripts before it are done, so the result reads as if they had run one after
+// another.  Returns their exit statuses, also in input order.
+inline std::vector<int> RunBatch(const std::vector<std::string>& filenames, const RunOptions& options,
+                                 size_t jobs, Output& out, std::ostream& errors) {
+  struct Slot {
+    ScriptResult result;
+    std::atomic<bool> done{false};
+  };
+  std::vector<Slot> slots(filenames.size());
+  jobs = std::max<size_t>(1, std::min(jobs, filenames.size()));
+  WorkQueues queues(jobs, filenames.size());
+
+  std::vector<std::thread> workers;
+  for (size_t worker = 0; worker < jobs; ++worker) {
+    workers.emplace_back([&, worker] {
+      size_t task;
+      while (queues.Next(worker, task)) {
+        slots[task].result = RunScript(filenames[task], options);
+        slots[task].done.store(true, std::memory_order_release);
+        slots[task].done.notify_one();
+      }
+    });
+  }
+
+  std::vector<int> statuses;
+  for (Slot& slot : slots) {
+    slot.done.wait(false, std::memory_order_acquire);
+    out.Write(slot.result.output);
+    if (!slot.result.error.empty()) {
+      out.Flush(); // Keep program output ahead of the message
+      errors << slot.result.error << std::endl;
+    }
+    statuses.push_back(slot.result.status);
+    slot.result = ScriptResult(); // Done with its output
+  }
+  for (std::thread& worker : workers) worker.join();
+  return statuses;
+}
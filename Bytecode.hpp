@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ASTNode.hpp"
+
+// Instructions operate on slots of the SymbolTable: variables, pooled constants and
+// compiler temporaries all live in the same contiguous value array.
+enum class OpCode : uint8_t {
+  MOVE,           // a = b
+  ADD,            // a = b + c
+  SUB,            // a = b - c
+  MUL,            // a = b * c
+  DIV,            // a = b / c   (errors on division by zero)
+  MOD,            // a = b % c
+  MOD_INT,        // a = b % c   (operands known to be integer-valued)
+  POW,            // a = b ** c
+  POW_INT,        // a = b ** c  (operands known to be integer-valued)
+  EQ,             // a = b == c
+  NE,             // a = b != c
+  GT,             // a = b > c
+  GE,             // a = b >= c
+  LT,             // a = b < c
+  LE,             // a = b <= c
+  NEG,            // a = -b
+  NOT,            // a = !b
+  TRUTH,          // a = (b != 0)
+  JUMP,           // goto a
+  JUMP_IF_TRUE,   // if (b != 0) goto a
+  JUMP_IF_FALSE,  // if (b == 0) goto a
+  JUMP_IF_EQ,     // if (b == c) goto a
+  JUMP_IF_NE,     // if (b != c) goto a
+  JUMP_IF_GT,     // if (b > c) goto a
+  JUMP_IF_GE,     // if (b >= c) goto a
+  JUMP_IF_LT,     // if (b < c) goto a
+  JUMP_IF_LE,     // if (b <= c) goto a
+  JUMP_UNLESS_EQ, // if (!(b == c)) goto a
+  JUMP_UNLESS_NE, // if (!(b != c)) goto a
+  JUMP_UNLESS_GT, // if (!(b > c)) goto a
+  JUMP_UNLESS_GE, // if (!(b >= c)) goto a
+  JUMP_UNLESS_LT, // if (!(b < c)) goto a
+  JUMP_UNLESS_LE, // if (!(b <= c)) goto a
+  STEP,           // count a loop iteration against the run's limits (only with limits)
+  PRINT_NUM,      // print slot a
+  PRINT_STRING,   // print interpolated string a
+  HALT
+};
+
+struct Instruction {
+  OpCode op;
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t c = 0;
+};
+
+// Compiled program: linear code plus the side tables the VM needs.
+struct Chunk {
+  std::vector<Instruction> code;
+  std::vector<NodeId> origins;                     // AST node each instruction came from
+  std::vector<std::vector<StringSegment>> strings; // Interpolated strings for PRINT_STRING
+
+  int Emit(Instruction inst, NodeId origin) {
+    code.push_back(inst);
+    origins.push_back(origin);
+    return static_cast<int>(code.size()) - 1;
+  }
+
+  int Here() const { return static_cast<int>(code.size()); }
+
+  void Clear() {
+    code.clear();
+    origins.clear();
+    strings.clear();
+  }
+};
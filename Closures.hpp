@@ -0,0 +1,340 @@
+#pragma once
+
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "Output.hpp"
+#include "SymbolTable.hpp"
+
+// Execution engine that turns the AST once into a tree of pre-specialized
+// closures: every node becomes a function pointer chosen for its operator and
+// operand kinds, so running it never re-tests a node Type or token id.
+class ClosureProgram {
+private:
+  struct Closure;
+
+  // What every closure can reach at run time
+  struct Context {
+    double* slots;
+    const AST& ast;
+    Output& out;
+  };
+
+  using Fn = double (*)(const Closure&, Context&);
+
+  // Where an operand comes from: a variable slot, a constant, or another closure
+  struct Operand {
+    int slot = -1;
+    double value = 0;
+    const Closure* closure = nullptr;
+  };
+
+  struct Closure {
+    Fn fn = nullptr;
+    Operand left, right;
+    int slot = -1;                        // Assignment target
+    const Closure* body = nullptr;        // IF/WHILE body, PRINT argument
+    const Closure* else_body = nullptr;
+    const Closure* const* list = nullptr; // STATEMENT_BLOCK statements
+    size_t count = 0;
+    const StringLiteral* string = nullptr;
+    NodeId origin = NO_NODE;              // For error reporting
+  };
+
+  // Operand accessors, resolved when a closure is built
+  struct FromSlot {
+    static double Get(const Operand& o, Context& ctx) { return ctx.slots[o.slot]; }
+  };
+  struct FromConstant {
+    static double Get(const Operand& o, Context&) { return o.value; }
+  };
+  struct FromClosure {
+    static double Get(const Operand& o, Context& ctx) { return o.closure->fn(*o.closure, ctx); }
+  };
+
+  // Operators
+  struct Add { static double Apply(double l, double r, const Closure&, Context&) { return Sum(l, r); } };
+  struct Sub { static double Apply(double l, double r, const Closure&, Context&) { return l - r; } };
+  struct Mul { static double Apply(double l, double r, const Closure&, Context&) { return Product(l, r); } };
+  struct Div {
+    static double Apply(double l, double r, const Closure& c, Context& ctx) {
+      if (r == 0) ctx.ast.Error("Division by zero", c.origin);
+      return l / r;
+    }
+  };
+  struct Mod {
+    static double Apply(double l, double r, const Closure& c, Context& ctx) {
+      r = round(r);
+      if (r == 0) ctx.ast.Error("Modulus by zero", c.origin);
+      return IntegerModulus(round(l), r);
+    }
+  };
+  struct IntMod {
+    static double Apply(double l, double r, const Closure& c, Context& ctx) {
+      if (r == 0) ctx.ast.Error("Modulus by zero", c.origin);
+      return IntegerModulus(l, r);
+    }
+  };
+  struct Pow { static double Apply(double l, double r, const Closure&, Context&) { return pow(l, r); } };
+  struct IntPow { static double Apply(double l, double r, const Closure&, Context&) { return IntegerPower(l, r); } };
+  struct Eq { static double Apply(double l, double r, const Closure&, Context&) { return l == r ? 1 : 0; } };
+  struct Ne { static double Apply(double l, double r, const Closure&, Context&) { return l != r ? 1 : 0; } };
+  struct Gt { static double Apply(double l, double r, const Closure&, Context&) { return l > r ? 1 : 0; } };
+  struct Ge { static double Apply(double l, double r, const Closure&, Context&) { return l >= r ? 1 : 0; } };
+  struct Lt { static double Apply(double l, double r, const Closure&, Context&) { return l < r ? 1 : 0; } };
+  struct Le { static double Apply(double l, double r, const Closure&, Context&) { return l <= r ? 1 : 0; } };
+
+  template <class Op, class L, class R>
+  static double Binary(const Closure& c, Context& ctx) {
+    double lvalue = L::Get(c.left, ctx); // Left before right: the right side may assign
+    double rvalue = R::Get(c.right, ctx);
+    return Op::Apply(lvalue, rvalue, c, ctx);
+  }
+
+  template <class L>
+  static double And(const Closure& c, Context& ctx) {
+    return L::Get(c.left, ctx) != 0 && FromClosure::Get(c.right, ctx) != 0 ? 1 : 0;
+  }
+
+  template <class L>
+  static double Or(const Closure& c, Context& ctx) {
+    return L::Get(c.left, ctx) != 0 || FromClosure::Get(c.right, ctx) != 0 ? 1 : 0;
+  }
+
+  template <class L>
+  static double Negate(const Closure& c, Context& ctx) { return -L::Get(c.left, ctx); }
+
+  template <class L>
+  static double Not(const Closure& c, Context& ctx) { return L::Get(c.left, ctx) == 0 ? 1 : 0; }
+
+  template <class L>
+  static double Assign(const Closure& c, Context& ctx) {
+    double value = L::Get(c.left, ctx);
+    ctx.slots[c.slot] = value;
+    return value;
+  }
+
+  static double Variable(const Closure& c, Context& ctx) { return ctx.slots[c.left.slot]; }
+  static double Constant(const Closure& c, Context&) { return c.left.value; }
+
+  static double PrintNumber(const Closure& c, Context& ctx) {
+    ctx.out.WriteNumber(FromClosure::Get(c.left, ctx));
+    ctx.out.Put('\n');
+    return 0;
+  }
+
+  static double PrintString(const Closure& c, Context& ctx) {
+    for (const StringSegment& segment : c.string->segments) {
+      ctx.out.Write(segment.literal);
+      if (segment.slot >= 0) ctx.out.WriteNumber(ctx.slots[segment.slot]);
+    }
+    ctx.out.Put('\n');
+    return 0;
+  }
+
+  static double Block(const Closure& c, Context& ctx) {
+    for (size_t i = 0; i < c.count; ++i) c.list[i]->fn(*c.list[i], ctx);
+    return 0;
+  }
+
+  static double If(const Closure& c, Context& ctx) {
+    if (FromClosure::Get(c.left, ctx) != 0) c.body->fn(*c.body, ctx);
+    else if (c.else_body) c.else_body->fn(*c.else_body, ctx);
+    return 0;
+  }
+
+  static double While(const Closure& c, Context& ctx) {
+    while (FromClosure::Get(c.left, ctx) != 0) c.body->fn(*c.body, ctx);
+    return 0;
+  }
+
+  // While, counting iterations against the run's limits
+  static double GovernedWhile(const Closure& c, Context& ctx) {
+    while (FromClosure::Get(c.left, ctx) != 0) {
+      ctx.ast.Step(c.origin);
+      c.body->fn(*c.body, ctx);
+    }
+    return 0;
+  }
+
+  static double Else(const Closure& c, Context& ctx) {
+    c.body->fn(*c.body, ctx);
+    return 0;
+  }
+
+  const AST& ast;
+  SymbolTable& symbols;
+  Output& out;
+  std::deque<Closure> closures;                    // Stable addresses
+  std::deque<std::vector<const Closure*>> lists;   // Statement lists of blocks
+  std::vector<const Closure*> roots;
+
+  Closure& New(NodeId origin) {
+    closures.emplace_back();
+    closures.back().origin = origin;
+    return closures.back();
+  }
+
+  Operand MakeOperand(NodeId id) {
+    Operand operand;
+    const ASTNode& node = ast[id];
+    if (node.type == VARIABLE) operand.slot = node.var;
+    else if (node.type == NUMBER) operand.value = node.value;
+    else operand.closure = Build(id);
+    return operand;
+  }
+
+  // Pick the instantiation of 'Tmpl' that matches the kind of operand 'o'
+  template <template <class> class Tmpl>
+  static Fn ByOperand(const Operand& o) {
+    if (o.closure) return &Tmpl<FromClosure>::Call;
+    if (o.slot >= 0) return &Tmpl<FromSlot>::Call;
+    return &Tmpl<FromConstant>::Call;
+  }
+
+  template <class Op>
+  static Fn ForBinary(const Operand& l, const Operand& r) {
+    auto kind = [](const Operand& o) { return o.closure ? 2 : o.slot >= 0 ? 0 : 1; };
+    switch (kind(l) * 3 + kind(r)) {
+      case 0: return &Binary<Op, FromSlot, FromSlot>;
+      case 1: return &Binary<Op, FromSlot, FromConstant>;
+      case 2: return &Binary<Op, FromSlot, FromClosure>;
+      case 3: return &Binary<Op, FromConstant, FromSlot>;
+      case 4: return &Binary<Op, FromConstant, FromConstant>;
+      case 5: return &Binary<Op, FromConstant, FromClosure>;
+      case 6: return &Binary<Op, FromClosure, FromSlot>;
+      case 7: return &Binary<Op, FromClosure, FromConstant>;
+      default: return &Binary<Op, FromClosure, FromClosure>;
+    }
+  }
+
+  template <class L> struct AndOf { static double Call(const Closure& c, Context& ctx) { return And<L>(c, ctx); } };
+  template <class L> struct OrOf { static double Call(const Closure& c, Context& ctx) { return Or<L>(c, ctx); } };
+  template <class L> struct NegateOf { static double Call(const Closure& c, Context& ctx) { return Negate<L>(c, ctx); } };
+  template <class L> struct NotOf { static double Call(const Closure& c, Context& ctx) { return Not<L>(c, ctx); } };
+  template <class L> struct AssignOf { static double Call(const Closure& c, Context& ctx) { return Assign<L>(c, ctx); } };
+
+  const Closure* Build(NodeId id) {
+    if (id == NO_NODE) return nullptr;
+    const ASTNode& node = ast[id];
+    Closure& c = New(id);
+
+    switch (node.type) {
+      case NUMBER:
+        c.left.value = node.value;
+        c.fn = &Constant;
+        break;
+
+      case VARIABLE:
+        c.left.slot = node.var;
+        c.fn = &Variable;
+        break;
+
+      case ASSIGNMENT:
+        c.slot = node.assign.var;
+        if (node.assign.value != NO_NODE) c.left = MakeOperand(node.assign.value);
+        c.fn = ByOperand<AssignOf>(c.left);
+        break;
+
+      case UNARY_OPERATION:
+        c.left = MakeOperand(node.binary.left);
+        if (node.op == emplex::Lexer::ID_negation) c.fn = ByOperand<NegateOf>(c.left);
+        else if (node.op == emplex::Lexer::ID_not) c.fn = ByOperand<NotOf>(c.left);
+        else ast.Error("Expected unary operation", id);
+        break;
+
+      case BINARY_OPERATION:
+        c.left = MakeOperand(node.binary.left);
+        if (node.op == emplex::Lexer::ID_and || node.op == emplex::Lexer::ID_or) {
+          c.right.closure = Build(node.binary.right);
+          c.fn = node.op == emplex::Lexer::ID_and ? ByOperand<AndOf>(c.left) : ByOperand<OrOf>(c.left);
+          break;
+        }
+        c.right = MakeOperand(node.binary.right);
+        switch (node.op) {
+          case emplex::Lexer::ID_add: c.fn = ForBinary<Add>(c.left, c.right); break;
+          case emplex::Lexer::ID_negation: c.fn = ForBinary<Sub>(c.left, c.right); break;
+          case emplex::Lexer::ID_multiply: c.fn = ForBinary<Mul>(c.left, c.right); break;
+          case emplex::Lexer::ID_divide: c.fn = ForBinary<Div>(c.left, c.right); break;
+          case emplex::Lexer::ID_modulus:
+            c.fn = node.integer_operands ? ForBinary<IntMod>(c.left, c.right) : ForBinary<Mod>(c.left, c.right);
+            break;
+          case emplex::Lexer::ID_exponent:
+            c.fn = node.integer_operands ? ForBinary<IntPow>(c.left, c.right) : ForBinary<Pow>(c.left, c.right);
+            break;
+          case emplex::Lexer::ID_equality: c.fn = ForBinary<Eq>(c.left, c.right); break;
+          case emplex::Lexer::ID_not_eq: c.fn = ForBinary<Ne>(c.left, c.right); break;
+          case emplex::Lexer::ID_greater_than: c.fn = ForBinary<Gt>(c.left, c.right); break;
+          case emplex::Lexer::ID_greater_or_eq: c.fn = ForBinary<Ge>(c.left, c.right); break;
+          case emplex::Lexer::ID_less_than: c.fn = ForBinary<Lt>(c.left, c.right); break;
+          case emplex::Lexer::ID_less_or_eq: c.fn = ForBinary<Le>(c.left, c.right); break;
+          default: ast.Error("Unknown binary operation", id);
+        }
+        break;
+
+      case PRINT:
+        if (ast[node.child].type == STRING) {
+          c.string = &ast.GetString(node.child);
+          c.fn = &PrintString;
+        } else {
+          c.left.closure = Build(node.child);
+          c.fn = &PrintNumber;
+        }
+        break;
+
+      case STRING: // A string outside print() prints itself
+        c.string = &ast.GetString(id);
+        c.fn = &PrintString;
+        break;
+
+      case STATEMENT_BLOCK: {
+        std::vector<const Closure*>& list = lists.emplace_back();
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) list.push_back(Build(*it));
+        c.list = list.data();
+        c.count = list.size();
+        c.fn = &Block;
+        break;
+      }
+
+      case IF_STATEMENT:
+        c.left.closure = Build(node.branch.cond);
+        c.body = Build(node.branch.body);
+        c.else_body = Build(node.branch.else_body);
+        c.fn = &If;
+        break;
+
+      case WHILE_LOOP:
+        c.left.closure = Build(node.branch.cond);
+        c.body = Build(node.branch.body);
+        c.fn = ast.GetGovernor() ? &GovernedWhile : &While;
+        break;
+
+      case ELSE_STATEMENT:
+        c.body = Build(node.child);
+        c.fn = &Else;
+        break;
+
+      default:
+        ast.Error("Unknown node type encountered during execution", id);
+    }
+    return &c;
+  }
+
+public:
+  ClosureProgram(const AST& ast, SymbolTable& symbols, Output& out) : ast(ast), symbols(symbols), out(out) {}
+
+  // Build closures for these top-level statements (replacing any earlier ones)
+  void Compile(const std::vector<NodeId>& nodes) {
+    closures.clear();
+    lists.clear();
+    roots.clear();
+    for (NodeId node : nodes) roots.push_back(Build(node));
+  }
+
+  void Run() {
+    Context ctx{symbols.Data(), ast, out};
+    for (const Closure* root : roots) root->fn(*root, ctx);
+  }
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "Bytecode.hpp"
+#include "SymbolTable.hpp"
+#include "Utils.hpp"
+
+// Lowers a parsed AST into linear bytecode for the VM.
+class Compiler {
+private:
+  Chunk& chunk;
+  const AST& ast;
+  SymbolTable& symbols;
+  std::unordered_map<uint64_t, int> constants; // bit pattern of value -> slot
+  std::vector<int> temps;                      // temporaries allocated so far
+  size_t temp_top = 0;                         // temporaries currently in use
+
+  int Constant(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto found = constants.find(bits);
+    if (found != constants.end()) return found->second;
+    int slot = symbols.AddSlot(value);
+    constants[bits] = slot;
+    return slot;
+  }
+
+  int PushTemp() {
+    if (temp_top == temps.size()) temps.push_back(symbols.AddSlot());
+    return temps[temp_top++];
+  }
+
+  bool IsTemp(int slot) const {
+    for (size_t i = 0; i < temp_top; ++i) {
+      if (temps[i] == slot) return true;
+    }
+    return false;
+  }
+
+  int Emit(OpCode op, int a, int b, int c, NodeId origin) {
+    return chunk.Emit({op, a, b, c}, origin);
+  }
+
+  void Patch(int jump, int target) { chunk.code[jump].a = target; }
+
+  // Does evaluating this subtree write to a variable?
+  bool HasAssignment(NodeId id) const {
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case ASSIGNMENT:
+        return true;
+      case UNARY_OPERATION:
+        return HasAssignment(node.binary.left);
+      case BINARY_OPERATION:
+        return HasAssignment(node.binary.left) || HasAssignment(node.binary.right);
+      default:
+        return false;
+    }
+  }
+
+  static OpCode BinaryOp(int token_id) {
+    switch (token_id) {
+      case emplex::Lexer::ID_add: return OpCode::ADD;
+      case emplex::Lexer::ID_negation: return OpCode::SUB;
+      case emplex::Lexer::ID_multiply: return OpCode::MUL;
+      case emplex::Lexer::ID_divide: return OpCode::DIV;
+      case emplex::Lexer::ID_modulus: return OpCode::MOD;
+      case emplex::Lexer::ID_exponent: return OpCode::POW;
+      case emplex::Lexer::ID_equality: return OpCode::EQ;
+      case emplex::Lexer::ID_not_eq: return OpCode::NE;
+      case emplex::Lexer::ID_greater_than: return OpCode::GT;
+      case emplex::Lexer::ID_greater_or_eq: return OpCode::GE;
+      case emplex::Lexer::ID_less_than: return OpCode::LT;
+      case emplex::Lexer::ID_less_or_eq: return OpCode::LE;
+    }
+    return OpCode::HALT;
+  }
+
+  static bool IsComparison(int token_id) {
+    switch (token_id) {
+      case emplex::Lexer::ID_equality:
+      case emplex::Lexer::ID_not_eq:
+      case emplex::Lexer::ID_greater_than:
+      case emplex::Lexer::ID_greater_or_eq:
+      case emplex::Lexer::ID_less_than:
+      case emplex::Lexer::ID_less_or_eq:
+        return true;
+    }
+    return false;
+  }
+
+  // Conditional jump for a comparison; 'when' selects jump-if-true vs jump-unless.
+  static OpCode BranchOp(int token_id, bool when) {
+    switch (token_id) {
+      case emplex::Lexer::ID_equality: return when ? OpCode::JUMP_IF_EQ : OpCode::JUMP_UNLESS_EQ;
+      case emplex::Lexer::ID_not_eq: return when ? OpCode::JUMP_IF_NE : OpCode::JUMP_UNLESS_NE;
+      case emplex::Lexer::ID_greater_than: return when ? OpCode::JUMP_IF_GT : OpCode::JUMP_UNLESS_GT;
+      case emplex::Lexer::ID_greater_or_eq: return when ? OpCode::JUMP_IF_GE : OpCode::JUMP_UNLESS_GE;
+      case emplex::Lexer::ID_less_than: return when ? OpCode::JUMP_IF_LT : OpCode::JUMP_UNLESS_LT;
+      case emplex::Lexer::ID_less_or_eq: return when ? OpCode::JUMP_IF_LE : OpCode::JUMP_UNLESS_LE;
+    }
+    return OpCode::HALT;
+  }
+
+  // Evaluate both operands of a binary node, keeping the left value stable if the
+  // right side assigns to the variable it was read from.
+  std::pair<int, int> CompileOperands(NodeId id) {
+    const ASTNode& node = ast[id];
+    int lhs = CompileExpression(node.binary.left);
+    if (!IsTemp(lhs) && HasAssignment(node.binary.right)) {
+      int copy = PushTemp();
+      Emit(OpCode::MOVE, copy, lhs, 0, id);
+      lhs = copy;
+    }
+    int rhs = CompileExpression(node.binary.right);
+    return {lhs, rhs};
+  }
+
+  // Result slot for an operation: the requested destination, or a fresh temporary.
+  int Destination(int dest) { return dest >= 0 ? dest : PushTemp(); }
+
+  // Compile an expression, returning the slot that holds its value.  If 'dest' is
+  // given, the final operation writes straight into it.
+  int CompileExpression(NodeId id, int dest = -1) {
+    const ASTNode& node = ast[id];
+    size_t mark = temp_top;
+    int result = -1;
+
+    switch (node.type) {
+      case NUMBER:
+        result = Constant(node.value);
+        break;
+
+      case VARIABLE:
+        result = node.var;
+        break;
+
+      case STRING:
+        Emit(OpCode::PRINT_STRING, AddString(id), 0, 0, id);
+        result = Constant(0);
+        break;
+
+      case ASSIGNMENT: {
+        int var = node.assign.var;
+        if (node.assign.value == NO_NODE) {
+          Emit(OpCode::MOVE, var, Constant(0), 0, id);
+        } else {
+          int value = CompileExpression(node.assign.value, var);
+          if (value != var) Emit(OpCode::MOVE, var, value, 0, id);
+        }
+        result = var;
+        break;
+      }
+
+      case UNARY_OPERATION: {
+        int operand = CompileExpression(node.binary.left);
+        temp_top = mark;
+        result = Destination(dest);
+        if (node.op == emplex::Lexer::ID_negation)
+          Emit(OpCode::NEG, result, operand, 0, id);
+        else if (node.op == emplex::Lexer::ID_not)
+          Emit(OpCode::NOT, result, operand, 0, id);
+        else
+          ast.Error("Expected unary operation", id);
+        break;
+      }
+
+      case BINARY_OPERATION: {
+        int op = node.op;
+        if (op == emplex::Lexer::ID_and || op == emplex::Lexer::ID_or) {
+          bool is_and = (op == emplex::Lexer::ID_and);
+          result = Destination(dest);
+          int lhs = CompileExpression(node.binary.left);
+          int short_circuit = Emit(is_and ? OpCode::JUMP_IF_FALSE : OpCode::JUMP_IF_TRUE, 0, lhs, 0, id);
+          int rhs = CompileExpression(node.binary.right);
+          Emit(OpCode::TRUTH, result, rhs, 0, id);
+          int done = Emit(OpCode::JUMP, 0, 0, 0, id);
+          Patch(short_circuit, chunk.Here());
+          Emit(OpCode::MOVE, result, Constant(is_and ? 0 : 1), 0, id);
+          Patch(done, chunk.Here());
+          break;
+        }
+
+        OpCode opcode = BinaryOp(op);
+        if (opcode == OpCode::HALT) ast.Error("Unknown binary operation", id);
+        if (node.integer_operands && opcode == OpCode::MOD) opcode = OpCode::MOD_INT;
+        if (node.integer_operands && opcode == OpCode::POW) opcode = OpCode::POW_INT;
+        auto [lhs, rhs] = CompileOperands(id);
+        temp_top = mark;
+        result = Destination(dest);
+        Emit(opcode, result, lhs, rhs, id);
+        break;
+      }
+
+      default:
+        ast.Error("Unexpected node type in expression", id);
+    }
+
+    // Release everything the operands used, keeping a temporary result reserved.
+    temp_top = (dest < 0 && IsTemp(result)) ? mark + 1 : mark;
+    return result;
+  }
+
+  // Emit code that jumps when the truth of 'node' equals 'when'; the jumps are
+  // appended to 'jumps' for the caller to patch.
+  void CompileCondition(NodeId id, bool when, std::vector<int>& jumps) {
+    const ASTNode& node = ast[id];
+    size_t mark = temp_top;
+
+    if (node.type == UNARY_OPERATION && node.op == emplex::Lexer::ID_not) {
+      CompileCondition(node.binary.left, !when, jumps);
+      return;
+    }
+
+    if (node.type == BINARY_OPERATION) {
+      int op = node.op;
+      bool is_and = (op == emplex::Lexer::ID_and);
+      if (is_and || op == emplex::Lexer::ID_or) {
+        // Jumping on the dominant value of the operator can reuse the same target
+        // for both operands; otherwise the left operand skips past the right one.
+        if (is_and != when) {
+          CompileCondition(node.binary.left, when, jumps);
+          CompileCondition(node.binary.right, when, jumps);
+        } else {
+          std::vector<int> skip;
+          CompileCondition(node.binary.left, !when, skip);
+          CompileCondition(node.binary.right, when, jumps);
+          for (int jump : skip) Patch(jump, chunk.Here());
+        }
+        return;
+      }
+
+      if (IsComparison(op)) {
+        auto [lhs, rhs] = CompileOperands(id);
+        temp_top = mark;
+        jumps.push_back(Emit(BranchOp(op, when), 0, lhs, rhs, id));
+        return;
+      }
+    }
+
+    int value = CompileExpression(id);
+    temp_top = mark;
+    jumps.push_back(Emit(when ? OpCode::JUMP_IF_TRUE : OpCode::JUMP_IF_FALSE, 0, value, 0, id));
+  }
+
+  int AddString(NodeId id) {
+    chunk.strings.push_back(ast.GetString(id).segments);
+    return static_cast<int>(chunk.strings.size()) - 1;
+  }
+
+  void CompileStatement(NodeId id) {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case PRINT:
+        if (ast[node.child].type == STRING) {
+          Emit(OpCode::PRINT_STRING, AddString(node.child), 0, 0, id);
+        } else {
+          int value = CompileExpression(node.child);
+          Emit(OpCode::PRINT_NUM, value, 0, 0, id);
+        }
+        break;
+
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) {
+          CompileStatement(*it);
+        }
+        break;
+
+      case IF_STATEMENT: {
+        std::vector<int> to_else;
+        CompileCondition(node.branch.cond, false, to_else);
+        CompileStatement(node.branch.body);
+        if (node.branch.else_body != NO_NODE) {
+          int to_end = Emit(OpCode::JUMP, 0, 0, 0, id);
+          for (int jump : to_else) Patch(jump, chunk.Here());
+          CompileStatement(node.branch.else_body);
+          Patch(to_end, chunk.Here());
+        } else {
+          for (int jump : to_else) Patch(jump, chunk.Here());
+        }
+        break;
+      }
+
+      case ELSE_STATEMENT:
+        CompileStatement(node.child);
+        break;
+
+      case WHILE_LOOP: {
+        // Test once on entry, then again at the bottom of the body so each
+        // iteration takes a single conditional jump.
+        std::vector<int> to_end;
+        CompileCondition(node.branch.cond, false, to_end);
+        int top = chunk.Here();
+        if (ast.GetGovernor()) Emit(OpCode::STEP, 0, 0, 0, id);
+        CompileStatement(node.branch.body);
+        std::vector<int> to_top;
+        CompileCondition(node.branch.cond, true, to_top);
+        for (int jump : to_top) Patch(jump, top);
+        for (int jump : to_end) Patch(jump, chunk.Here());
+        break;
+      }
+
+      default:
+        CompileExpression(id);
+        break;
+    }
+    temp_top = 0;
+  }
+
+public:
+  Compiler(Chunk& chunk, const AST& ast, SymbolTable& symbols) : chunk(chunk), ast(ast), symbols(symbols) {}
+
+  void Compile(const std::vector<NodeId>& nodes) {
+    for (NodeId node : nodes) {
+      CompileStatement(node);
+    }
+    Emit(OpCode::HALT, 0, 0, 0, NO_NODE);
+  }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "ASTNode.hpp"
+
+// What one top-level statement does with the program's variables, by unique id
+// (which is also the variable's SymbolTable slot).
+struct StatementAccess {
+  std::vector<int> reads;  // Sorted, without duplicates
+  std::vector<int> writes; // Sorted, without duplicates
+  bool may_fail = false;   // Has a division or modulus that could fail at run time
+  bool loops = false;      // Has a while loop, so is worth a thread of its own
+};
+
+// Finds what top-level statements share, so that those that share nothing can
+// run at the same time: two statements depend on each other when one writes a
+// variable that the other reads or writes.  Statements that only read the same
+// variables stay independent.
+class Dependencies {
+private:
+  const AST& ast;
+
+  void Collect(NodeId id, StatementAccess& access) const {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case VARIABLE:
+        access.reads.push_back(node.var);
+        break;
+      case STRING:
+        for (const StringSegment& segment : ast.GetString(id).segments) {
+          if (segment.slot >= 0) access.reads.push_back(segment.slot);
+        }
+        break;
+      case ASSIGNMENT:
+        access.writes.push_back(node.assign.var);
+        Collect(node.assign.value, access);
+        break;
+      case UNARY_OPERATION:
+        Collect(node.binary.left, access);
+        break;
+      case BINARY_OPERATION: {
+        NodeId right = node.binary.right;
+        bool constant = ast[right].type == NUMBER;
+        if (node.op == emplex::Lexer::ID_divide && !(constant && ast[right].value != 0)) access.may_fail = true;
+        if (node.op == emplex::Lexer::ID_modulus && !(constant && round(ast[right].value) != 0)) access.may_fail = true;
+        Collect(node.binary.left, access);
+        Collect(right, access);
+        break;
+      }
+      case PRINT:
+      case ELSE_STATEMENT:
+        Collect(node.child, access);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) Collect(*it, access);
+        break;
+      case WHILE_LOOP:
+        access.loops = true;
+        [[fallthrough]];
+      case IF_STATEMENT:
+        Collect(node.branch.cond, access);
+        Collect(node.branch.body, access);
+        Collect(node.branch.else_body, access);
+        break;
+      default:
+        break;
+    }
+  }
+
+  static void SortUnique(std::vector<int>& ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  }
+
+public:
+  explicit Dependencies(const AST& ast) : ast(ast) {}
+
+  StatementAccess Analyze(NodeId statement) const {
+    StatementAccess access;
+    Collect(statement, access);
+    SortUnique(access.reads);
+    SortUnique(access.writes);
+    return access;
+  }
+};
+
+// Consecutive top-level statements split into independent groups as they are
+// added: no statement depends on one in another group.  Within a group they
+// keep program order.
+class StatementGroups {
+private:
+  static constexpr size_t NONE = static_cast<size_t>(-1);
+
+  std::vector<size_t> parent;             // Union-find over the statements added
+  std::vector<bool> loops;                // By root: the group has a while loop
+  std::vector<size_t> writer;             // By variable: a statement that writes it
+  std::vector<std::vector<size_t>> readers; // By variable: readers seen before any writer
+
+  size_t Find(size_t i) {
+    while (parent[i] != i) i = parent[i] = parent[parent[i]];
+    return i;
+  }
+
+  void Join(size_t a, size_t b) {
+    a = Find(a);
+    b = Find(b);
+    if (a == b) return;
+    if (a > b) std::swap(a, b); // Keep the first statement as the root
+    parent[b] = a;
+    loops[a] = loops[a] || loops[b];
+  }
+
+  void Reserve(const std::vector<int>& vars) {
+    if (!vars.empty() && static_cast<size_t>(vars.back()) >= writer.size()) {
+      writer.resize(vars.back() + 1, NONE);
+      readers.resize(vars.back() + 1);
+    }
+  }
+
+public:
+  size_t size() const { return parent.size(); }
+
+  // Would a statement with 'access' tie together two groups that loop?  Those
+  // are the ones worth running at the same time, so it should wait for both.
+  bool JoinsLoops(const StatementAccess& access) {
+    size_t found = NONE;
+    auto check = [&](size_t statement) {
+      size_t root = Find(statement);
+      if (!loops[root] || root == found) return false;
+      if (found != NONE) return true;
+      found = root;
+      return false;
+    };
+    for (int var : access.reads) {
+      if (static_cast<size_t>(var) < writer.size() && writer[var] != NONE && check(writer[var])) return true;
+    }
+    for (int var : access.writes) {
+      if (static_cast<size_t>(var) >= writer.size()) continue;
+      if (writer[var] != NONE && check(writer[var])) return true;
+      for (size_t reader : readers[var]) {
+        if (check(reader)) return true;
+      }
+    }
+    return false;
+  }
+
+  void Add(const StatementAccess& access) {
+    size_t i = parent.size();
+    parent.push_back(i);
+    loops.push_back(access.loops);
+    Reserve(access.reads);
+    Reserve(access.writes);
+    for (int var : access.reads) {
+      if (writer[var] != NONE) Join(i, writer[var]);
+      else readers[var].push_back(i);
+    }
+    for (int var : access.writes) {
+      if (writer[var] != NONE) Join(i, writer[var]);
+      writer[var] = i;
+      for (size_t reader : readers[var]) Join(i, reader);
+      readers[var].clear(); // Later readers join the writer instead
+    }
+  }
+
+  // The groups so far, as indices in the order statements were added; groups
+  // are ordered by their first statement.  'looping' receives which of them loop.
+  std::vector<std::vector<size_t>> Groups(std::vector<bool>& looping) {
+    std::vector<std::vector<size_t>> groups;
+    std::vector<size_t> index(parent.size(), NONE); // Group of each root
+    looping.clear();
+    for (size_t i = 0; i < parent.size(); ++i) {
+      size_t root = Find(i);
+      if (index[root] == NONE) {
+        index[root] = groups.size();
+        groups.emplace_back();
+        looping.push_back(loops[root]);
+      }
+      groups[index[root]].push_back(i);
+    }
+    return groups;
+  }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "lexer.hpp"
+
+// Runs of bytes the lexer skips in bulk instead of one transition at a time:
+// whitespace, the rest of a // comment and the body of a string.
+enum class Run : uint8_t { NONE, BLANK, LINE, QUOTE };
+
+// Does 'run' continue through byte 'c'?  Control bytes (below 9, which the DFA
+// treats specially) and non-ASCII bytes end every run.
+constexpr bool InRun(Run run, unsigned char c) {
+  switch (run) {
+  case Run::BLANK: return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  case Run::LINE: return c >= 9 && c < 128 && c != '\n';
+  case Run::QUOTE: return c >= 9 && c < 128 && c != '"';
+  default: return false;
+  }
+}
+
+// Does seeing the end of the line change the token a lexeme ending in DFA state
+// 'state' would be?
+constexpr bool EolMatters(int state) {
+  int eol = emplex::DFA::GetStop(emplex::DFA::GetNext(state, emplex::DFA::SYMBOL_STOP));
+  return eol != 0 && eol != emplex::DFA::GetStop(state);
+}
+
+// The run DFA state 'state' can skip, if every byte of the run loops back to it.
+constexpr Run RunOf(int state) {
+  if (EolMatters(state)) return Run::NONE;
+  for (Run run : {Run::LINE, Run::QUOTE, Run::BLANK}) {
+    bool loops = true;
+    for (int c = 0; c < 256 && loops; ++c) {
+      if (InRun(run, static_cast<unsigned char>(c))) loops = emplex::DFA::GetNext(state, c) == state;
+    }
+    if (loops) return run;
+  }
+  return Run::NONE;
+}
+
+// emplex::DFA repacked at compile time.  Bytes that no state tells apart share
+// a class and states fit in a byte, so the transition table is 64 bytes per
+// state (under 5 KiB) rather than 128 ints; rows are padded to a power of two
+// so that finding one is a shift.  States are renumbered so that all those
+// needing more than a stop check come after DEAD, which makes the common case
+// a single compare: those are states where the end of a line matters, and a
+// copy of each run state that transitions looping back to it lead to, so that
+// a run is skipped in bulk once it is more than a byte long.
+class CompactDFA {
+private:
+  using DFA = emplex::DFA;
+  static constexpr int DFA_STATES = static_cast<int>(DFA::size());
+
+  struct Numbering {
+    std::array<uint8_t, DFA_STATES> id;       // New number of each DFA state
+    std::array<uint8_t, DFA_STATES> looping;  // Number of its looping copy (or 'id')
+    int dead;
+    int count;
+  };
+  static constexpr Numbering numbering = [] {
+    Numbering result{};
+    int next_id = 0;
+    for (int s = 0; s < DFA_STATES; ++s) {
+      if (!EolMatters(s)) result.id[s] = static_cast<uint8_t>(next_id++);
+    }
+    result.dead = next_id++;
+    for (int s = 0; s < DFA_STATES; ++s) {
+      if (EolMatters(s)) result.id[s] = static_cast<uint8_t>(next_id++);
+    }
+    for (int s = 0; s < DFA_STATES; ++s) {
+      result.looping[s] = RunOf(s) == Run::NONE ? result.id[s] : static_cast<uint8_t>(next_id++);
+    }
+    result.count = next_id;
+    return result;
+  }();
+
+public:
+  static constexpr int NUM_STATES = numbering.count;   // Including DEAD
+  static constexpr uint8_t DEAD = static_cast<uint8_t>(numbering.dead);  // The DFA's -1
+  static constexpr uint8_t START = numbering.id[0];
+  static constexpr uint8_t LINE_START = numbering.id[static_cast<size_t>(DFA::GetNext(0, DFA::SYMBOL_START))];
+
+  // Class of each byte; non-ASCII bytes (which end any token) get the last one.
+  static constexpr std::array<uint8_t, 256> byte_class = [] {
+    std::array<uint8_t, 256> classes{};
+    std::array<int, 128> representative{};
+    int count = 0;
+    for (int c = 0; c < 128; ++c) {
+      int found = count;
+      for (int k = 0; k < count && found == count; ++k) {
+        bool same = true;
+        for (int s = 0; s < DFA_STATES && same; ++s) {
+          same = DFA::GetNext(s, c) == DFA::GetNext(s, representative[k]);
+        }
+        if (same) found = k;
+      }
+      if (found == count) representative[count++] = c;
+      classes[c] = static_cast<uint8_t>(found);
+    }
+    for (int c = 128; c < 256; ++c) classes[c] = static_cast<uint8_t>(count);
+    return classes;
+  }();
+  static constexpr int NUM_CLASSES = byte_class[255] + 1;
+  static constexpr int ROW_SHIFT = std::bit_width(static_cast<unsigned>(NUM_CLASSES - 1));
+
+  // Next state, indexed by (state << ROW_SHIFT) + class.
+  static constexpr std::array<uint8_t, NUM_STATES << ROW_SHIFT> next = [] {
+    std::array<uint8_t, NUM_STATES << ROW_SHIFT> table{};
+    table.fill(DEAD);
+    for (int s = 0; s < DFA_STATES; ++s) {
+      for (int c = 0; c < 128; ++c) {
+        int target = DFA::GetNext(s, c);
+        uint8_t to = target < 0 ? DEAD : target == s ? numbering.looping[s] : numbering.id[target];
+        table[static_cast<size_t>((numbering.id[s] << ROW_SHIFT) + byte_class[c])] = to;
+        table[static_cast<size_t>((numbering.looping[s] << ROW_SHIFT) + byte_class[c])] = to;
+      }
+    }
+    return table;
+  }();
+
+  // Token id if a lexeme may end in each state, 0 otherwise; 'eol_stop' is the
+  // id once the end of the line is seen, where that differs.
+  static constexpr std::array<uint8_t, NUM_STATES> stop = [] {
+    std::array<uint8_t, NUM_STATES> ids{};
+    for (int s = 0; s < DFA_STATES; ++s) {
+      ids[numbering.id[s]] = ids[numbering.looping[s]] = static_cast<uint8_t>(DFA::GetStop(s));
+    }
+    return ids;
+  }();
+  static constexpr std::array<uint8_t, NUM_STATES> eol_stop = [] {
+    std::array<uint8_t, NUM_STATES> ids{};
+    for (int s = 0; s < DFA_STATES; ++s) {
+      if (EolMatters(s)) ids[numbering.id[s]] = static_cast<uint8_t>(DFA::GetStop(DFA::GetNext(s, DFA::SYMBOL_STOP)));
+    }
+    return ids;
+  }();
+
+  // Run to skip on entering each state (only looping copies have one).
+  static constexpr std::array<Run, NUM_STATES> run = [] {
+    std::array<Run, NUM_STATES> runs{};
+    for (int s = 0; s < DFA_STATES; ++s) {
+      if (numbering.looping[s] != numbering.id[s]) runs[numbering.looping[s]] = RunOf(s);
+    }
+    return runs;
+  }();
+};
+
+static_assert([] {
+  for (int s = 0; s < static_cast<int>(emplex::DFA::size()); ++s) {
+    int eol = emplex::DFA::GetNext(s, emplex::DFA::SYMBOL_STOP);
+    if (emplex::DFA::GetStop(s) > 255 || emplex::DFA::GetStop(eol) > 255) return false;
+  }
+  return CompactDFA::NUM_STATES <= 256;
+}(), "DFA states and token ids must fit in a byte");
+
+// Drop-in replacement for emplex::Lexer's NextToken()/Tokenize() built on
+// CompactDFA; it produces exactly the same tokens.
+class FastLexer {
+private:
+  using Tables = CompactDFA;
+
+  size_t start_pos = 0;
+
+  // Bitmask of the bytes in a vector that end 'run'.
+#if defined(__AVX2__)
+  template <Run run>
+  static uint32_t Ends(__m256i bytes) {
+    if constexpr (run == Run::BLANK) {
+      __m256i blank = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))));
+      return ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+    } else {
+      // Signed compare: non-ASCII bytes are negative, so below 9 as well.
+      __m256i control = _mm256_cmpgt_epi8(_mm256_set1_epi8(9), bytes);
+      __m256i end = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(run == Run::LINE ? '\n' : '"'));
+      return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(control, end)));
+    }
+  }
+  static constexpr size_t WIDTH = 32;
+  using Vector = __m256i;
+  static Vector Load(const unsigned char* at) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at)); }
+#elif defined(__SSE2__)
+  template <Run run>
+  static uint32_t Ends(__m128i bytes) {
+    if constexpr (run == Run::BLANK) {
+      __m128i blank = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))));
+      return ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFF;
+    } else {
+      // Signed compare: non-ASCII bytes are negative, so below 9 as well.
+      __m128i control = _mm_cmplt_epi8(bytes, _mm_set1_epi8(9));
+      __m128i end = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(run == Run::LINE ? '\n' : '"'));
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(control, end)));
+    }
+  }
+  static constexpr size_t WIDTH = 16;
+  using Vector = __m128i;
+  static Vector Load(const unsigned char* at) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(at)); }
+#endif
+
+  // First position at or after 'pos' that is not part of 'run'.
+  template <Run run>
+  static size_t Skip(const unsigned char* bytes, size_t pos, size_t size) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; pos + WIDTH <= size; pos += WIDTH) {
+      if (uint32_t ends = Ends<run>(Load(bytes + pos))) return pos + static_cast<size_t>(__builtin_ctz(ends));
+    }
+#endif
+    while (pos < size && InRun(run, bytes[pos])) ++pos;
+    return pos;
+  }
+
+  static size_t Skip(Run run, const unsigned char* bytes, size_t pos, size_t size) {
+    switch (run) {
+    case Run::BLANK: return Skip<Run::BLANK>(bytes, pos, size);
+    case Run::LINE: return Skip<Run::LINE>(bytes, pos, size);
+    case Run::QUOTE: return Skip<Run::QUOTE>(bytes, pos, size);
+    default: return pos;
+    }
+  }
+
+public:
+  // Generate and return the next token from the input stream (EOF at the end).
+  emplex::Token NextToken(std::string_view in) {
+    const size_t size = in.size();
+    if (start_pos >= size) return { emplex::Lexer::ID__EOF_, in.substr(size) };
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in.data());
+    size_t pos = start_pos;
+    size_t best_pos = start_pos;
+    int best_stop = -1;
+    unsigned state = (start_pos == 0 || bytes[start_pos - 1] == '\n') ? Tables::LINE_START : Tables::START;
+
+    // Longest match, as in emplex::Lexer::NextToken().
+    while (pos < size) {
+      state = Tables::next[(state << Tables::ROW_SHIFT) + Tables::byte_class[bytes[pos++]]];
+      if (state >= Tables::DEAD) {
+        if (state == Tables::DEAD) break;
+        pos = Skip(Tables::run[state], bytes, pos, size);
+        if (Tables::eol_stop[state] && (pos == size || bytes[pos] == '\n')) {
+          best_pos = pos;
+          best_stop = Tables::eol_stop[state];
+          continue;
+        }
+      }
+      if (Tables::stop[state]) { best_pos = pos; best_stop = Tables::stop[state]; }
+    }
+
+    // No token matched: the single character is its own id.
+    if (best_pos == start_pos) { best_stop = in[start_pos]; best_pos++; }
+
+    std::string_view lexeme = in.substr(start_pos, best_pos - start_pos);
+    start_pos = best_pos;
+    return { best_stop, lexeme };
+  }
+
+  // Convert an input string into a vector of tokens, dropping whitespace and comments.
+  std::vector<emplex::Token> Tokenize(std::string_view in) {
+    start_pos = 0;
+    std::vector<emplex::Token> out_tokens;
+    out_tokens.reserve(in.size() / 4);    // Typical scripts run 3-6 bytes per token
+    while (emplex::Token token = NextToken(in)) {
+      if (!emplex::Lexer::IgnoreToken(token.id)) out_tokens.push_back(token);
+    }
+    return out_tokens;
+  }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Utils.hpp"
+#include "lexer.hpp"
+
+// Resource limits for one run of a script; zero means no limit.
+struct Limits {
+  uint64_t steps = 0;  // While-loop iterations, over all loops of the run
+  double seconds = 0;  // Wall time since the run started
+  size_t memory = 0;   // Bytes of the run's tokens, AST, variables and captured output
+
+  bool Any() const { return steps || seconds > 0 || memory; }
+};
+
+// Enforces Limits during a run.  Every while-loop iteration decrements
+// 'countdown', which is all the engines pay while it stays above zero; when it
+// reaches zero they call Check(), which adds up the steps, looks at the clock
+// and re-arms the countdown.  Engines only count iterations when Active(), so a
+// run without limits pays nothing at all.  The parser checks memory as the
+// program grows; while it runs, only captured output grows (see Output).
+class Governor {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // Iterations between clock checks; small enough to notice a limit
+  // within a millisecond or so, large enough that the checks cost well under 1%
+  static constexpr uint64_t CHECK_INTERVAL = uint64_t{1} << 16;
+
+  Limits limits;
+  Clock::time_point start = Clock::now();
+  uint64_t steps = 0; // Iterations counted by Check() so far
+  uint64_t batch = 0; // What 'countdown' was last armed with
+
+  void Arm() {
+    batch = CHECK_INTERVAL;
+    if (limits.steps && limits.steps - steps < batch) batch = limits.steps - steps + 1; // Stop right past the limit
+    countdown = batch;
+  }
+
+  static std::string Number(double value) {
+    std::string text = std::to_string(value);
+    text.erase(text.find_last_not_of('0') + 1); // to_string always gives six decimals
+    if (text.back() == '.') text.pop_back();
+    return text;
+  }
+
+public:
+  uint64_t countdown = 0; // Iterations left before the next Check()
+
+  explicit Governor(const Limits& limits = {}) : limits(limits) {
+    if (Active()) Arm();
+  }
+
+  bool Active() const { return limits.Any(); }
+
+  // Called when 'countdown' runs out: fails the run at 'where' if it went past
+  // a limit, otherwise arms the countdown again.
+  void Check(const emplex::Token& where, std::string_view source) {
+    steps += batch;
+    if (limits.steps && steps > limits.steps) {
+      Utils::limit_error("Step limit of " + std::to_string(limits.steps) + " loop iterations exceeded", where, source);
+    }
+    CheckTime(where, source);
+    Arm();
+  }
+
+  // Fail the run at 'where' if it has used up its time
+  void CheckTime(const emplex::Token& where, std::string_view source) const {
+    if (limits.seconds > 0 && std::chrono::duration<double>(Clock::now() - start).count() > limits.seconds) {
+      Utils::limit_error("Time limit of " + Number(limits.seconds) + " seconds exceeded", where, source);
+    }
+  }
+
+  // Fail the run at 'where' if the program takes more than its memory, 'bytes'
+  void CheckMemory(size_t bytes, const emplex::Token& where, std::string_view source) const {
+    if (limits.memory && bytes > limits.memory) {
+      Utils::limit_error("Memory limit of " + Number(limits.memory / 1048576.0) + " MB exceeded", where, source);
+    }
+  }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Raw binary encoding of program images (see ImageCache.hpp).  Values are
+// stored in native byte order and layout, so an image is only good for the
+// build that wrote it.
+class ImageWriter {
+private:
+  std::string bytes;
+
+public:
+  template <typename T>
+  void Put(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void PutArray(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Put<uint64_t>(values.size());
+    bytes.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  void PutString(std::string_view text) {
+    Put<uint64_t>(text.size());
+    bytes.append(text);
+  }
+
+  const std::string& Bytes() const { return bytes; }
+};
+
+// Reads back what an ImageWriter wrote; every Get fails (returns false) rather
+// than read past the end of the image.
+class ImageReader {
+private:
+  const char* pos;
+  const char* end;
+
+  bool Take(void* out, size_t size) {
+    if (static_cast<size_t>(end - pos) < size) return false;
+    std::memcpy(out, pos, size);
+    pos += size;
+    return true;
+  }
+
+public:
+  ImageReader(std::string_view image) : pos(image.data()), end(image.data() + image.size()) {}
+
+  template <typename T>
+  bool Get(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return Take(&value, sizeof(T));
+  }
+
+  template <typename T>
+  bool GetArray(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t count;
+    if (!Get(count) || count > static_cast<size_t>(end - pos) / sizeof(T)) return false;
+    values.resize(count);
+    return Take(values.data(), count * sizeof(T));
+  }
+
+  // A count of items that each take at least 8 bytes, so a damaged image
+  // cannot ask for a huge allocation
+  bool GetCount(uint64_t& count) {
+    return Get(count) && count <= static_cast<size_t>(end - pos) / 8;
+  }
+
+  bool GetString(std::string& text) {
+    uint64_t size;
+    if (!Get(size) || size > static_cast<size_t>(end - pos)) return false;
+    text.assign(pos, size);
+    pos += size;
+    return true;
+  }
+
+  bool AtEnd() const { return pos == end; }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "Image.hpp"
+#include "Parser.hpp"
+#include "Stats.hpp"
+
+// On-disk cache of prepared (lexed, parsed and optimized) programs, so that a
+// repeat run of a large script maps a binary image of its AST and goes straight
+// to execution.  Images live next to the script ("script.Mc.p2img") or, given a
+// directory, in there named by the hash of the source text.  An image is used
+// only if its header matches the source text, the optimize setting and the
+// build of the interpreter; otherwise the script is parsed and the image
+// rewritten.  Writes go through a temporary file and a rename, so concurrent
+// runs never see half an image.
+class ImageCache {
+private:
+  struct Header {
+    char magic[8];
+    uint64_t build;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t optimized;
+    bool operator==(const Header&) const = default;
+  };
+
+  std::string dir; // Empty: next to the script
+
+  // Identifies this build: images store raw structs, so any rebuild invalidates them.
+  static constexpr uint64_t BuildId() {
+    constexpr std::string_view stamp = __DATE__ " " __TIME__ " " __VERSION__;
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (char c : stamp) hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return hash ^ (sizeof(ASTNode) << 56);
+  }
+
+  static Header HeaderFor(std::string_view source, const RunOptions& options) {
+    return {{'P', '2', 'I', 'M', 'A', 'G', 'E', '1'}, BuildId(), std::hash<std::string_view>{}(source),
+            source.size(), options.optimize};
+  }
+
+  std::string PathFor(const std::string& filename, std::string_view source) const {
+    if (!dir.empty()) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "%016llx.p2img",
+                    static_cast<unsigned long long>(std::hash<std::string_view>{}(source)));
+      return dir + "/" + name;
+    }
+    return filename == "-" ? "" : filename + ".p2img"; // No place for stdin's image
+  }
+
+public:
+  explicit ImageCache(std::string dir = "") : dir(std::move(dir)) {}
+
+  // Load the image of 'source' into a fresh 'parser', ready for RunPrepared();
+  // false if there is no usable image.
+  bool Load(Parser& parser, const std::string& filename, std::string_view source, const RunOptions& options) const {
+    PhaseClock clock(options.stats);
+    std::string path = PathFor(filename, source);
+    int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+      close(fd);
+      return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    ImageReader image({static_cast<const char*>(mapping), size});
+    Header header;
+    bool loaded = image.Get(header) && header == HeaderFor(source, options) && parser.LoadImage(image);
+    munmap(mapping, size);
+    clock.Lap(&PhaseTimes::image);
+    return loaded;
+  }
+
+  // Write the image of the program 'parser' prepared from 'source'.  Failing to
+  // write it only costs the next run its head start, so errors are ignored.
+  void Store(const Parser& parser, const std::string& filename, std::string_view source,
+             const RunOptions& options) const {
+    PhaseClock clock(options.stats);
+    std::string path = PathFor(filename, source);
+    if (path.empty()) return;
+    if (!dir.empty()) mkdir(dir.c_str(), 0777); // Fine if it already exists
+
+    ImageWriter image;
+    image.Put(HeaderFor(source, options));
+    parser.SaveImage(image);
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    std::ofstream file(temp, std::ios::binary);
+    file.write(image.Bytes().data(), static_cast<std::streamsize>(image.Bytes().size()));
+    file.close();
+    if (!file || std::rename(temp.c_str(), path.c_str()) != 0) std::remove(temp.c_str());
+    clock.Lap(&PhaseTimes::image);
+  }
+};
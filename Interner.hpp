@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Identifier names as small dense integers, one per distinct name, so that the
+// parser resolves variables by indexing instead of hashing strings.
+using Symbol = uint32_t;
+
+class Interner {
+private:
+  struct Hash {
+    using is_transparent = void; // Look up string_views without making strings
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+  };
+  std::unordered_map<std::string, Symbol, Hash, std::equal_to<>> symbols;
+  std::vector<const std::string*> names; // By symbol; map keys never move
+  size_t node_bytes = 0;                 // Hash nodes and the strings they hold
+
+public:
+  static constexpr Symbol NONE = UINT32_MAX;
+
+  // Symbol of 'name', made up the first time it is seen
+  Symbol Intern(std::string_view name) {
+    auto found = symbols.find(name);
+    if (found != symbols.end()) return found->second;
+    auto [added, inserted] = symbols.emplace(std::string(name), static_cast<Symbol>(names.size()));
+    names.push_back(&added->first);
+    node_bytes += sizeof(*added) + 2 * sizeof(void*); // Node with next pointer and cached hash
+    if (added->first.capacity() > 15) node_bytes += added->first.capacity() + 1; // Beyond small-string storage
+    return added->second;
+  }
+
+  // Symbol of 'name', or NONE if it was never interned
+  Symbol Find(std::string_view name) const {
+    auto found = symbols.find(name);
+    return found == symbols.end() ? NONE : found->second;
+  }
+
+  const std::string& Name(Symbol symbol) const { return *names[symbol]; }
+  size_t size() const { return names.size(); }
+
+  // Approximate bytes held: hash nodes, their strings and the name index
+  size_t Bytes() const {
+    return symbols.bucket_count() * sizeof(void*) + names.capacity() * sizeof(names[0]) + node_bytes;
+  }
+};
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cmath>
+#include <csetjmp>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "Output.hpp"
+#include "SymbolTable.hpp"
+
+// What native code calls back into: the AST for error messages and the output.
+struct JitRuntime {
+  const AST* ast;
+  Output* out;
+  double* slots;
+  std::jmp_buf* escape;       // Errors jump back to Jit::Run() through here
+  std::exception_ptr* error;  // ... leaving the ScriptError to rethrow here
+};
+
+// Executable machine code for one statement; owns its mapping.
+class NativeCode {
+private:
+  using Entry = void (*)(double* slots, const JitRuntime* runtime);
+  void* memory = nullptr;
+  size_t size = 0;
+
+public:
+  NativeCode() = default;
+  NativeCode(void* memory, size_t size) : memory(memory), size(size) {}
+  NativeCode(NativeCode&& other) noexcept
+    : memory(std::exchange(other.memory, nullptr)), size(std::exchange(other.size, 0)) {}
+  NativeCode& operator=(NativeCode&& other) noexcept {
+    std::swap(memory, other.memory);
+    std::swap(size, other.size);
+    return *this;
+  }
+  ~NativeCode() {
+    if (memory) munmap(memory, size);
+  }
+
+  explicit operator bool() const { return memory != nullptr; }
+
+  void Run(const JitRuntime& runtime) const { reinterpret_cast<Entry>(memory)(runtime.slots, &runtime); }
+};
+
+// Compiles statements that contain while loops to x86-64 machine code.  Values
+// stay doubles with the same semantics as AST::Run: variables live in the
+// SymbolTable slot array (addressed from rbx), expression temporaries in xmm
+// registers by nesting depth, and prints, modulus, ** and errors call back into
+// the runtime.  Compile() returns empty code for anything it does not handle,
+// and the caller runs that statement on its engine instead.
+class Jit {
+private:
+  const AST& ast;
+  SymbolTable& symbols;
+  Output& out;
+
+  std::vector<uint8_t> code;
+  bool failed = false;
+  std::jmp_buf escape;       // Set by Run() for Fail()
+  std::exception_ptr error;
+
+  static constexpr int SCRATCH = 15;  // xmm15: zero / sign mask / call results
+  static constexpr int MAX_DEPTH = 14; // Temporaries use xmm0..xmm14
+
+  // Callbacks; native code calls these with the System V ABI.  Printing fails
+  // only when captured output goes past a memory limit.
+  static void PrintNumber(const JitRuntime* runtime, double value) {
+    try {
+      runtime->out->WriteNumber(value);
+      runtime->out->Put('\n');
+      return;
+    } catch (...) {
+      *runtime->error = std::current_exception();
+    }
+    std::longjmp(*runtime->escape, 1);
+  }
+
+  static void PrintString(const JitRuntime* runtime, const StringLiteral* string) {
+    try {
+      for (const StringSegment& segment : string->segments) {
+        runtime->out->Write(segment.literal);
+        if (segment.slot >= 0) runtime->out->WriteNumber(runtime->slots[segment.slot]);
+      }
+      runtime->out->Put('\n');
+      return;
+    } catch (...) {
+      *runtime->error = std::current_exception();
+    }
+    std::longjmp(*runtime->escape, 1);
+  }
+
+  // Exceptions cannot unwind through native frames (they have no unwind tables),
+  // so the error is kept and control jumps straight back to Run(), which rethrows it.
+  [[noreturn]] static void Fail(const JitRuntime* runtime, const char* message, uint32_t id) {
+    try {
+      runtime->ast->Error(message, id);
+    } catch (...) {
+      *runtime->error = std::current_exception();
+    }
+    std::longjmp(*runtime->escape, 1);
+  }
+
+  static double Modulus(const JitRuntime* runtime, double lvalue, double rvalue, uint32_t id) {
+    rvalue = round(rvalue);
+    if (rvalue == 0) Fail(runtime, "Modulus by zero", id);
+    return IntegerModulus(round(lvalue), rvalue);
+  }
+
+  static double Power(double lvalue, double rvalue) { return pow(lvalue, rvalue); }
+  static double ExactPower(double lvalue, double rvalue) { return IntegerPower(lvalue, rvalue); }
+
+  // Called when the Governor's countdown runs out at the loop 'id'
+  static void CheckLimits(const JitRuntime* runtime, uint32_t id) {
+    try {
+      runtime->ast->CheckLimits(id);
+      return;
+    } catch (...) {
+      *runtime->error = std::current_exception();
+    }
+    std::longjmp(*runtime->escape, 1);
+  }
+
+  static void DivisionByZero(const JitRuntime* runtime, uint32_t id) { Fail(runtime, "Division by zero", id); }
+
+  // --- Encoding ---------------------------------------------------------------
+
+  void Byte(uint8_t b) { code.push_back(b); }
+  void Bytes(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+  void Imm32(uint32_t value) { for (int i = 0; i < 4; ++i) Byte(static_cast<uint8_t>(value >> (8 * i))); }
+  void Imm64(uint64_t value) { for (int i = 0; i < 8; ++i) Byte(static_cast<uint8_t>(value >> (8 * i))); }
+
+  // SSE instruction 'prefix 0F op' between xmm registers
+  void SseRR(uint8_t prefix, uint8_t op, int reg, int rm) {
+    Byte(prefix);
+    if (reg >= 8 || rm >= 8) Byte(0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+    Bytes({0x0F, op, static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))});
+  }
+
+  // SSE instruction with a slot operand [rbx + 8 * slot]
+  void SseSlot(uint8_t prefix, uint8_t op, int reg, int slot) {
+    Byte(prefix);
+    if (reg >= 8) Byte(0x44);
+    Bytes({0x0F, op, static_cast<uint8_t>(0x83 | ((reg & 7) << 3))});
+    Imm32(static_cast<uint32_t>(slot) * 8);
+  }
+
+  // SSE instruction with a stack operand [rsp + offset]
+  void SseStack(uint8_t op, int reg, uint32_t offset) {
+    Byte(0xF2);
+    if (reg >= 8) Byte(0x44);
+    Bytes({0x0F, op, static_cast<uint8_t>(0x84 | ((reg & 7) << 3)), 0x24});
+    Imm32(offset);
+  }
+
+  void Move(int dst, int src) { if (dst != src) SseRR(0xF2, 0x10, dst, src); }   // movsd
+  void Load(int reg, int slot) { SseSlot(0xF2, 0x10, reg, slot); }               // movsd xmm, [slot]
+  void Store(int slot, int reg) { SseSlot(0xF2, 0x11, reg, slot); }              // movsd [slot], xmm
+  void Zero(int reg) { SseRR(0x66, 0x57, reg, reg); }                             // xorpd
+  void Compare(int a, int b) { SseRR(0x66, 0x2E, a, b); }                         // ucomisd
+
+  void LoadConstant(int reg, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0) return Zero(reg);
+    Bytes({0x48, 0xB8}); // mov rax, imm64
+    Imm64(bits);
+    Bytes({0x66, static_cast<uint8_t>(0x48 | (reg >= 8 ? 4 : 0)), 0x0F, 0x6E,
+           static_cast<uint8_t>(0xC0 | ((reg & 7) << 3))}); // movq xmm, rax
+  }
+
+  // reg = al ? 1.0 : 0.0
+  void FromFlag(int reg) {
+    Bytes({0x0F, 0xB6, 0xC0}); // movzx eax, al
+    Byte(0xF2);
+    if (reg >= 8) Byte(0x44);
+    Bytes({0x0F, 0x2A, static_cast<uint8_t>(0xC0 | ((reg & 7) << 3))}); // cvtsi2sd xmm, eax
+  }
+
+  void Call(const void* function) {
+    Bytes({0x48, 0xB8}); // mov rax, imm64
+    Imm64(reinterpret_cast<uint64_t>(function));
+    Bytes({0xFF, 0xD0}); // call rax
+  }
+
+  void RuntimeArg() { Bytes({0x4C, 0x89, 0xE7}); } // mov rdi, r12
+  void IdArg(NodeId id) { Byte(0xBE); Imm32(id); }  // mov esi, imm32
+
+  // Jumps with a 32-bit displacement, patched once the target is known
+  size_t Jump() { Byte(0xE9); Imm32(0); return code.size(); }
+  size_t JumpIf(uint8_t cc) { Bytes({0x0F, static_cast<uint8_t>(0x80 | cc)}); Imm32(0); return code.size(); }
+  void Patch(size_t after, size_t target) {
+    uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(after));
+    std::memcpy(&code[after - 4], &rel, 4);
+  }
+  void JumpBack(size_t target) { Patch(Jump(), target); }
+
+  static constexpr uint8_t CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_P = 0xA;
+
+  // --- Calls that keep xmm0..depth-1 alive --------------------------------------
+
+  uint32_t SpillSize(int depth) { return static_cast<uint32_t>((depth * 8 + 15) / 16 * 16); }
+
+  void Spill(int depth) {
+    if (depth == 0) return;
+    Bytes({0x48, 0x81, 0xEC}); Imm32(SpillSize(depth)); // sub rsp, n
+    for (int i = 0; i < depth; ++i) SseStack(0x11, i, 8 * i);
+  }
+
+  // Restore the spilled registers and put the call result (xmm0) in 'depth'
+  void Unspill(int depth) {
+    if (depth == 0) return;
+    Move(SCRATCH, 0);
+    for (int i = 0; i < depth; ++i) SseStack(0x10, i, 8 * i);
+    Bytes({0x48, 0x81, 0xC4}); Imm32(SpillSize(depth)); // add rsp, n
+    Move(depth, SCRATCH);
+  }
+
+  // xmm[depth] = function(xmm[depth], xmm[depth + 1]) via a callback
+  void CallBinary(const void* function, int depth, NodeId id, bool with_runtime) {
+    Spill(depth);
+    Move(0, depth);
+    Move(1, depth + 1);
+    if (with_runtime) {
+      RuntimeArg();
+      IdArg(id);
+    }
+    Call(function);
+    Unspill(depth);
+  }
+
+  // xmm[depth] %= xmm[depth + 1] for integer-valued operands, with idiv when both
+  // convert to int64 (cvttsd2si yields INT64_MIN otherwise) and the callback if not.
+  void IntegerModulusInline(int depth, NodeId id) {
+    auto convert = [this](uint8_t gpr, int xmm) { // cvttsd2si gpr, xmm
+      Bytes({0xF2, static_cast<uint8_t>(0x48 | (xmm >= 8 ? 1 : 0)), 0x0F, 0x2C,
+             static_cast<uint8_t>(0xC0 | (gpr << 3) | (xmm & 7))});
+    };
+    convert(0, depth);     // rax = lvalue
+    convert(1, depth + 1); // rcx = rvalue
+    Bytes({0x48, 0xBA});   // mov rdx, INT64_MIN
+    Imm64(uint64_t{1} << 63);
+    Bytes({0x48, 0x39, 0xD0}); // cmp rax, rdx
+    size_t slow_left = JumpIf(CC_E);
+    Bytes({0x48, 0x39, 0xD1}); // cmp rcx, rdx
+    size_t slow_right = JumpIf(CC_E);
+    Bytes({0x48, 0x85, 0xC9}); // test rcx, rcx
+    size_t zero = JumpIf(CC_E);
+    Bytes({0x48, 0x83, 0xF9, 0xFF}); // cmp rcx, -1
+    size_t minus_one = JumpIf(CC_E);
+    Bytes({0x48, 0x63, 0xD0, 0x48, 0x39, 0xC2}); // movsxd rdx, eax; cmp rdx, rax
+    size_t wide_left = JumpIf(CC_NE);
+    Bytes({0x48, 0x63, 0xD1, 0x48, 0x39, 0xCA}); // movsxd rdx, ecx; cmp rdx, rcx
+    size_t wide_right = JumpIf(CC_NE);
+    Bytes({0x99, 0xF7, 0xF9}); // cdq; idiv ecx (much faster than the 64-bit form)
+    Byte(0xF2);
+    if (depth >= 8) Byte(0x44);
+    Bytes({0x0F, 0x2A, static_cast<uint8_t>(0xC2 | ((depth & 7) << 3))}); // cvtsi2sd xmm, edx
+    size_t done_narrow = Jump();
+
+    Patch(wide_left, code.size());
+    Patch(wide_right, code.size());
+    Bytes({0x48, 0x99, 0x48, 0xF7, 0xF9}); // cqo; idiv rcx
+    Bytes({0xF2, static_cast<uint8_t>(0x48 | (depth >= 8 ? 4 : 0)), 0x0F, 0x2A,
+           static_cast<uint8_t>(0xC2 | ((depth & 7) << 3))}); // cvtsi2sd xmm, rdx
+    size_t done = Jump();
+
+    Patch(minus_one, code.size());
+    Zero(depth);
+    size_t done_minus_one = Jump();
+
+    Patch(zero, code.size()); // The callback reports the error
+    Patch(slow_left, code.size());
+    Patch(slow_right, code.size());
+    CallBinary(reinterpret_cast<const void*>(&Modulus), depth, id, true);
+
+    Patch(done, code.size());
+    Patch(done_narrow, code.size());
+    Patch(done_minus_one, code.size());
+  }
+
+  // --- Code generation ----------------------------------------------------------
+
+  static bool IsComparison(const ASTNode& node) {
+    if (node.type != BINARY_OPERATION) return false;
+    switch (node.op) {
+      case emplex::Lexer::ID_equality: case emplex::Lexer::ID_not_eq:
+      case emplex::Lexer::ID_greater_than: case emplex::Lexer::ID_greater_or_eq:
+      case emplex::Lexer::ID_less_than: case emplex::Lexer::ID_less_or_eq:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Sets flags for a comparison; > and >= compare (l, r), < and <= (r, l)
+  void EmitComparison(const ASTNode& node, int depth) {
+    Expression(node.binary.left, depth);
+    Expression(node.binary.right, depth + 1);
+    if (node.op == emplex::Lexer::ID_less_than || node.op == emplex::Lexer::ID_less_or_eq) Compare(depth + 1, depth);
+    else Compare(depth, depth + 1);
+  }
+
+  // Sets flags for 'xmm[depth] != 0'
+  void EmitTruth(int depth) {
+    Zero(SCRATCH);
+    Compare(depth, SCRATCH);
+  }
+
+  // Jump-if-false for a condition; returns the jumps to patch to the false target
+  std::vector<size_t> BranchIfFalse(NodeId cond) {
+    const ASTNode& node = ast[cond];
+    if (!IsComparison(node)) {
+      Expression(cond, 0);
+      EmitTruth(0);
+      size_t nan = JumpIf(CC_P); // NaN != 0
+      size_t zero = JumpIf(CC_E);
+      Patch(nan, code.size());
+      return {zero};
+    }
+
+    EmitComparison(node, 0);
+    switch (node.op) {
+      case emplex::Lexer::ID_equality: return {JumpIf(CC_NE), JumpIf(CC_P)};
+      case emplex::Lexer::ID_not_eq: {
+        size_t unordered = JumpIf(CC_P);
+        size_t equal = JumpIf(CC_E);
+        Patch(unordered, code.size());
+        return {equal};
+      }
+      case emplex::Lexer::ID_greater_than: case emplex::Lexer::ID_less_than: return {JumpIf(CC_BE)};
+      default: return {JumpIf(CC_B)};
+    }
+  }
+
+  // Evaluate expression 'id' into xmm[depth]
+  void Expression(NodeId id, int depth) {
+    if (depth > MAX_DEPTH) {
+      failed = true;
+      return;
+    }
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case NUMBER:
+        LoadConstant(depth, node.value);
+        return;
+
+      case VARIABLE:
+        Load(depth, node.var);
+        return;
+
+      case ASSIGNMENT:
+        if (node.assign.value == NO_NODE) Zero(depth);
+        else Expression(node.assign.value, depth);
+        Store(node.assign.var, depth);
+        return;
+
+      case UNARY_OPERATION:
+        Expression(node.binary.left, depth);
+        if (node.op == emplex::Lexer::ID_negation) {
+          LoadConstant(SCRATCH, -0.0);
+          SseRR(0x66, 0x57, depth, SCRATCH); // xorpd with the sign bit
+        } else if (node.op == emplex::Lexer::ID_not) {
+          EmitTruth(depth);
+          Bytes({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8}); // sete al; setnp cl; and al, cl
+          FromFlag(depth);
+        } else {
+          failed = true;
+        }
+        return;
+
+      case BINARY_OPERATION:
+        break;
+
+      default:
+        failed = true; // Strings and statements are not expressions
+        return;
+    }
+
+    if (node.op == emplex::Lexer::ID_and || node.op == emplex::Lexer::ID_or) {
+      bool is_and = node.op == emplex::Lexer::ID_and;
+      std::vector<size_t> to_true, to_false;
+      for (NodeId operand : {node.binary.left, node.binary.right}) {
+        Expression(operand, depth);
+        EmitTruth(depth);
+        if (is_and) {
+          size_t nan = JumpIf(CC_P);
+          to_false.push_back(JumpIf(CC_E));
+          Patch(nan, code.size());
+        } else {
+          to_true.push_back(JumpIf(CC_P));
+          to_true.push_back(JumpIf(CC_NE));
+        }
+      }
+      if (!is_and) {
+        Zero(depth);
+        size_t done = Jump();
+        for (size_t jump : to_true) Patch(jump, code.size());
+        LoadConstant(depth, 1);
+        Patch(done, code.size());
+        return;
+      }
+      LoadConstant(depth, 1);
+      size_t done = Jump();
+      for (size_t jump : to_false) Patch(jump, code.size());
+      Zero(depth);
+      Patch(done, code.size());
+      return;
+    }
+
+    if (IsComparison(node)) {
+      EmitComparison(node, depth);
+      switch (node.op) {
+        case emplex::Lexer::ID_equality: Bytes({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8}); break; // ZF && !PF
+        case emplex::Lexer::ID_not_eq: Bytes({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8}); break;   // !ZF || PF
+        case emplex::Lexer::ID_greater_than: case emplex::Lexer::ID_less_than: Bytes({0x0F, 0x97, 0xC0}); break; // seta
+        default: Bytes({0x0F, 0x93, 0xC0}); break; // setae
+      }
+      FromFlag(depth);
+      return;
+    }
+
+    Expression(node.binary.left, depth);
+    const ASTNode& right = ast[node.binary.right];
+    uint8_t op = 0;
+    switch (node.op) {
+      case emplex::Lexer::ID_add: op = 0x58; break;
+      case emplex::Lexer::ID_multiply: op = 0x59; break;
+      case emplex::Lexer::ID_negation: op = 0x5C; break;
+      case emplex::Lexer::ID_divide: op = 0x5E; break;
+    }
+
+    // Arithmetic on a variable reads it straight from its slot
+    if (op && op != 0x5E && right.type == VARIABLE) {
+      SseSlot(0xF2, op, depth, right.var);
+      return;
+    }
+
+    Expression(node.binary.right, depth + 1);
+    switch (node.op) {
+      case emplex::Lexer::ID_divide: {
+        EmitTruth(depth + 1);
+        size_t nan = JumpIf(CC_P);
+        size_t nonzero = JumpIf(CC_NE);
+        RuntimeArg();
+        IdArg(id);
+        Call(reinterpret_cast<const void*>(&DivisionByZero)); // Does not return
+        Patch(nan, code.size());
+        Patch(nonzero, code.size());
+        SseRR(0xF2, op, depth, depth + 1);
+        return;
+      }
+      case emplex::Lexer::ID_modulus:
+        if (node.integer_operands) IntegerModulusInline(depth, id);
+        else CallBinary(reinterpret_cast<const void*>(&Modulus), depth, id, true);
+        return;
+      case emplex::Lexer::ID_exponent:
+        CallBinary(reinterpret_cast<const void*>(node.integer_operands ? &ExactPower : &Power), depth, id, false);
+        return;
+      default:
+        if (op) SseRR(0xF2, op, depth, depth + 1);
+        else failed = true;
+    }
+  }
+
+  void Statement(NodeId id) {
+    if (failed || id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case PRINT:
+        if (ast[node.child].type == STRING) {
+          RuntimeArg();
+          Bytes({0x48, 0xBE}); // mov rsi, imm64
+          Imm64(reinterpret_cast<uint64_t>(&ast.GetString(node.child)));
+          Call(reinterpret_cast<const void*>(&PrintString));
+        } else {
+          Expression(node.child, 0);
+          RuntimeArg();
+          Call(reinterpret_cast<const void*>(&PrintNumber));
+        }
+        return;
+
+      case STRING:
+        RuntimeArg();
+        Bytes({0x48, 0xBE});
+        Imm64(reinterpret_cast<uint64_t>(&ast.GetString(id)));
+        Call(reinterpret_cast<const void*>(&PrintString));
+        return;
+
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) Statement(*it);
+        return;
+
+      case ELSE_STATEMENT:
+        Statement(node.child);
+        return;
+
+      case IF_STATEMENT: {
+        std::vector<size_t> to_else = BranchIfFalse(node.branch.cond);
+        Statement(node.branch.body);
+        size_t done = node.branch.else_body != NO_NODE ? Jump() : 0;
+        for (size_t jump : to_else) Patch(jump, code.size());
+        if (node.branch.else_body != NO_NODE) {
+          Statement(node.branch.else_body);
+          Patch(done, code.size());
+        }
+        return;
+      }
+
+      case WHILE_LOOP: {
+        size_t top = code.size();
+        std::vector<size_t> to_exit = BranchIfFalse(node.branch.cond);
+        if (Governor* governor = ast.GetGovernor()) { // Count down, calling out only at zero
+          Bytes({0x48, 0xB8}); // mov rax, imm64
+          Imm64(reinterpret_cast<uint64_t>(&governor->countdown));
+          Bytes({0x48, 0xFF, 0x08}); // dec qword [rax]
+          size_t counting = JumpIf(CC_NE);
+          RuntimeArg();
+          IdArg(id);
+          Call(reinterpret_cast<const void*>(&CheckLimits));
+          Patch(counting, code.size());
+        }
+        Statement(node.branch.body);
+        JumpBack(top);
+        for (size_t jump : to_exit) Patch(jump, code.size());
+        return;
+      }
+
+      default: // Expression statements
+        Expression(id, 0);
+    }
+  }
+
+public:
+  Jit(const AST& ast, SymbolTable& symbols, Output& out) : ast(ast), symbols(symbols), out(out) {}
+
+  // Whether compiling a statement is worth it: only those with a loop inside
+  static bool HasLoop(const AST& ast, NodeId id) {
+    if (id == NO_NODE) return false;
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case WHILE_LOOP:
+        return true;
+      case IF_STATEMENT:
+        return HasLoop(ast, node.branch.body) || HasLoop(ast, node.branch.else_body);
+      case ELSE_STATEMENT:
+        return HasLoop(ast, node.child);
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) {
+          if (HasLoop(ast, *it)) return true;
+        }
+        return false;
+      default:
+        return false;
+    }
+  }
+
+  // Machine code for a top-level statement, or empty code if it cannot be compiled.
+  // The code refers to the statement's string literals, so it must run before the
+  // AST is cleared.
+  NativeCode Compile(NodeId id) {
+#if defined(__x86_64__) && defined(__linux__)
+    code.clear();
+    failed = false;
+    Bytes({0x53, 0x41, 0x54, 0x48, 0x83, 0xEC, 0x08}); // push rbx; push r12; sub rsp, 8
+    Bytes({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});       // mov rbx, rdi; mov r12, rsi
+    Statement(id);
+    Bytes({0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3}); // add rsp, 8; pop r12; pop rbx; ret
+    if (failed) return {};
+
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return {};
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, code.size());
+      return {};
+    }
+    return NativeCode(memory, code.size());
+#else
+    (void)id;
+    return {};
+#endif
+  }
+
+  void Run(const NativeCode& native) {
+    JitRuntime runtime{&ast, &out, symbols.Data(), &escape, &error};
+    if (setjmp(escape) == 0) {
+      native.Run(runtime);
+    } else {
+      std::rethrow_exception(std::exchange(error, nullptr));
+    }
+  }
+};
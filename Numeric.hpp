@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Arithmetic shared by every engine, so that they all compute the same values.
+
+// l + r and l * r with the operands in program order.  When both are NaN, x86
+// returns the first one, sign included, and the compiler is free to swap the
+// operands of + and *; doing the instruction here keeps every engine's NaN the same.
+inline double Sum(double lvalue, double rvalue) {
+#if defined(__x86_64__)
+  asm("addsd %1, %0" : "+x"(lvalue) : "x"(rvalue));
+  return lvalue;
+#else
+  return lvalue + rvalue;
+#endif
+}
+
+inline double Product(double lvalue, double rvalue) {
+#if defined(__x86_64__)
+  asm("mulsd %1, %0" : "+x"(lvalue) : "x"(rvalue));
+  return lvalue;
+#else
+  return lvalue * rvalue;
+#endif
+}
+
+// l % r for operands already rounded to integers, with r != 0.  Uses 32- or
+// 64-bit integers when both fit (32-bit division is much faster on many CPUs),
+// fmod() (exact for integers) otherwise; NaN and infinities end up in fmod() too.
+inline double IntegerModulus(double lvalue, double rvalue) {
+  if (std::fabs(lvalue) < 0x1p31 && std::fabs(rvalue) < 0x1p31) {
+    int32_t divisor = static_cast<int32_t>(rvalue);
+    if (divisor == -1) return 0; // INT32_MIN % -1 would trap
+    return static_cast<double>(static_cast<int32_t>(lvalue) % divisor);
+  }
+  if (std::fabs(lvalue) < 0x1p63 && std::fabs(rvalue) < 0x1p63) {
+    int64_t divisor = static_cast<int64_t>(rvalue);
+    if (divisor == -1) return 0; // INT64_MIN % -1 would trap
+    return static_cast<double>(static_cast<int64_t>(lvalue) % divisor);
+  }
+  return std::fmod(lvalue, rvalue);
+}
+
+// x ** n for integer-valued x and n.  Small non-negative exponents whose result
+// stays exactly representable are computed by squaring; everything else (and
+// -0, whose sign pow() keeps) goes to pow(), which gives the same exact results.
+inline double IntegerPower(double base, double exponent) {
+  constexpr int64_t EXACT = int64_t{1} << 53;
+  if (exponent >= 0 && exponent < 64 && base != 0 && std::fabs(base) < 0x1p53) {
+    int64_t factor = static_cast<int64_t>(base);
+    int64_t result = 1;
+    for (unsigned bits = static_cast<unsigned>(exponent); bits; bits >>= 1) {
+      if ((bits & 1) && __builtin_mul_overflow(result, factor, &result)) return std::pow(base, exponent);
+      if (bits > 1 && __builtin_mul_overflow(factor, factor, &factor)) return std::pow(base, exponent);
+    }
+    if (result >= -EXACT && result <= EXACT) return static_cast<double>(result);
+  }
+  return std::pow(base, exponent);
+}
@@ -0,0 +1,750 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "SymbolTable.hpp"
+
+// Rewrites a parsed program in place before it is executed:
+//  - folds BINARY_OPERATION / UNARY_OPERATION subtrees whose operands are constant
+//  - drops IF_STATEMENT / WHILE_LOOP branches whose condition is constant
+//  - reduces x * 2 and x / 2^k to cheaper exact equivalents
+//  - hoists loop-invariant expressions into temporaries set before the loop
+//  - computes repeated subexpressions of a statement once
+//  - removes stores to variables that are never read (whole programs only)
+//  - marks % and ** whose operands are proven integer-valued (whole programs only)
+// Operations that fail at run time (division or modulus by zero) are never folded
+// or dropped, so the error is still reported when execution reaches them.
+class Optimizer {
+private:
+  AST& ast;
+  SymbolTable& symbols;
+  std::vector<bool> is_read; // Indexed by variable unique id
+  std::vector<bool> is_integral; // Indexed by variable unique id: every value stored is integer-valued
+  std::vector<int>* temporaries; // Slots of earlier temporaries to use again, if any
+  size_t temporaries_used = 0;
+  bool changed = false;
+
+  // A slot no other temporary of these statements uses
+  int NewTemporary() {
+    if (!temporaries) return symbols.AddSlot();
+    if (temporaries_used == temporaries->size()) temporaries->push_back(symbols.AddSlot());
+    return (*temporaries)[temporaries_used++];
+  }
+
+  bool IsNumber(NodeId id) const { return ast[id].type == NUMBER; }
+
+  void MakeNumber(NodeId id, double value) {
+    ASTNode& node = ast[id];
+    node.type = NUMBER;
+    node.op = 0;
+    node.value = value;
+  }
+
+  // Turn a statement into an empty block, which executes as a no-op.
+  void MakeEmpty(NodeId id) {
+    ASTNode& node = ast[id];
+    node.type = STATEMENT_BLOCK;
+    node.block = {0, 0};
+  }
+
+  bool IsEmpty(NodeId id) const {
+    return ast[id].type == STATEMENT_BLOCK && ast[id].block.count == 0;
+  }
+
+  // Could a modulus with this right-hand side fail at run time?
+  static bool ModulusMayFail(double rvalue) { return round(rvalue) == 0; }
+
+  // Can a binary operation with constant operands be evaluated now, with exactly
+  // the result (and no error) that it would produce at run time?
+  static bool CanFold(int op, double rvalue) {
+    if (op == emplex::Lexer::ID_divide) return rvalue != 0;
+    if (op == emplex::Lexer::ID_modulus) return !ModulusMayFail(rvalue);
+    return true;
+  }
+
+  // Constant folding, bottom up.  Constant subtrees are evaluated with AST::Run so
+  // the folded value is bit-identical to what execution would compute.
+  void Fold(NodeId id) {
+    ASTNode& node = ast[id];
+    switch (node.type) {
+      case ASSIGNMENT:
+        if (node.assign.value != NO_NODE) Fold(node.assign.value);
+        break;
+
+      case UNARY_OPERATION:
+        Fold(node.binary.left);
+        if (IsNumber(node.binary.left)) MakeNumber(id, ast.Run(id, symbols));
+        break;
+
+      case BINARY_OPERATION: {
+        NodeId left = node.binary.left, right = node.binary.right;
+        Fold(left);
+        if (node.op == emplex::Lexer::ID_and || node.op == emplex::Lexer::ID_or) {
+          bool is_and = (node.op == emplex::Lexer::ID_and);
+          if (IsNumber(left) && (ast[left].value != 0) != is_and) {
+            // Short-circuits: the right side is never evaluated.
+            MakeNumber(id, is_and ? 0 : 1);
+            break;
+          }
+          Fold(right);
+          if (IsNumber(left) && IsNumber(right)) MakeNumber(id, ast[right].value != 0 ? 1 : 0);
+          break;
+        }
+
+        Fold(right);
+        if (IsNumber(left) && IsNumber(right) && CanFold(node.op, ast[right].value)) {
+          MakeNumber(id, ast.Run(id, symbols));
+        } else {
+          Reduce(id);
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  // Strength reduction of a BINARY_OPERATION whose operands are already folded.
+  // Every rewrite gives bit-identical results for all operand values, NaN and -0
+  // included; operands are duplicated only when they are plain variables.
+  // Exponents are left alone: pow(x, 2) is not always rounded like x * x, and
+  // pow(x, 1) drops the sign of a NaN.
+  void Reduce(NodeId id) {
+    const ASTNode& node = ast[id];
+    NodeId left = node.binary.left, right = node.binary.right;
+    auto is = [this](NodeId operand, double value) { return IsNumber(operand) && ast[operand].value == value; };
+
+    switch (node.op) {
+      case emplex::Lexer::ID_multiply: {
+        NodeId other = is(right, 2) ? left : is(left, 2) ? right : NO_NODE;
+        if (other != NO_NODE && ast[other].type == VARIABLE) {
+          NodeId copy = ast.AddCopy(other); // x * 2 == x + x
+          ast[id].op = emplex::Lexer::ID_add;
+          ast[id].binary = {other, copy};
+        }
+        break;
+      }
+
+      case emplex::Lexer::ID_divide:
+        if (IsNumber(right)) {
+          // x / 2^k == x * 2^-k when 2^-k is a normal double: both round the same real value
+          double divisor = ast[right].value;
+          double reciprocal = 1 / divisor;
+          int exponent;
+          if (std::fabs(std::frexp(divisor, &exponent)) == 0.5 && std::isfinite(reciprocal) &&
+              std::fabs(reciprocal) >= DBL_MIN) {
+            ast[right].value = reciprocal;
+            ast[id].op = emplex::Lexer::ID_multiply;
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  void FoldStatement(NodeId id) {
+    if (id == NO_NODE) return;
+    ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case PRINT:
+        Fold(node.child);
+        break;
+
+      case STATEMENT_BLOCK:
+        for (NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) {
+          FoldStatement(*it);
+        }
+        break;
+
+      case IF_STATEMENT:
+        Fold(node.branch.cond);
+        FoldStatement(node.branch.body);
+        FoldStatement(node.branch.else_body);
+        if (IsNumber(node.branch.cond)) {
+          NodeId taken = ast[node.branch.cond].value != 0 ? node.branch.body : node.branch.else_body;
+          if (taken == NO_NODE) MakeEmpty(id);
+          else ast[id] = ast[taken];
+        }
+        break;
+
+      case WHILE_LOOP:
+        Fold(node.branch.cond);
+        FoldStatement(node.branch.body);
+        if (IsNumber(node.branch.cond) && ast[node.branch.cond].value == 0) MakeEmpty(id);
+        break;
+
+      default:
+        Fold(id);
+        break;
+    }
+  }
+
+  // Record every variable that some expression or interpolated string reads.
+  void CollectReads(NodeId id) {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case VARIABLE:
+        is_read[node.var] = true;
+        break;
+      case STRING:
+        for (const StringSegment& segment : ast.GetString(id).segments) {
+          if (segment.slot >= 0) is_read[segment.slot] = true;
+        }
+        break;
+      case ASSIGNMENT:
+        CollectReads(node.assign.value);
+        break;
+      case UNARY_OPERATION:
+        CollectReads(node.binary.left);
+        break;
+      case BINARY_OPERATION:
+        CollectReads(node.binary.left);
+        CollectReads(node.binary.right);
+        break;
+      case PRINT:
+      case ELSE_STATEMENT:
+        CollectReads(node.child);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) CollectReads(*it);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        CollectReads(node.branch.cond);
+        CollectReads(node.branch.body);
+        CollectReads(node.branch.else_body);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Is every value of this expression integer-valued (or NaN/infinite, which rounding
+  // leaves alone too), given what is known about variables so far?
+  bool IsIntegral(NodeId id) const {
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case NUMBER:
+        return node.value == round(node.value);
+      case VARIABLE:
+        return is_integral[node.var];
+      case ASSIGNMENT:
+        return node.assign.value == NO_NODE || IsIntegral(node.assign.value);
+      case UNARY_OPERATION:
+        return node.op == emplex::Lexer::ID_not || IsIntegral(node.binary.left);
+      case BINARY_OPERATION:
+        switch (node.op) {
+          case emplex::Lexer::ID_add:
+          case emplex::Lexer::ID_negation:
+          case emplex::Lexer::ID_multiply:
+            return IsIntegral(node.binary.left) && IsIntegral(node.binary.right);
+          case emplex::Lexer::ID_divide:
+            return false;
+          case emplex::Lexer::ID_exponent: // Only non-negative integer powers stay integral
+            return IsIntegral(node.binary.left) && IsNumber(node.binary.right) && ast[node.binary.right].value >= 0 &&
+                   IsIntegral(node.binary.right);
+          default: // %, comparisons and logic operators
+            return true;
+        }
+      default:
+        return false;
+    }
+  }
+
+  // One pass of the integer analysis: clear variables that are assigned a value not
+  // known to be integral, and mark % and ** by what is known now.
+  void ProveIntegers(NodeId id) {
+    if (id == NO_NODE) return;
+    ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case ASSIGNMENT:
+        ProveIntegers(node.assign.value);
+        if (is_integral[node.assign.var] && !IsIntegral(id)) {
+          is_integral[node.assign.var] = false;
+          changed = true;
+        }
+        break;
+      case UNARY_OPERATION:
+        ProveIntegers(node.binary.left);
+        break;
+      case BINARY_OPERATION:
+        ProveIntegers(node.binary.left);
+        ProveIntegers(node.binary.right);
+        if (node.op == emplex::Lexer::ID_modulus || node.op == emplex::Lexer::ID_exponent) {
+          node.integer_operands = IsIntegral(node.binary.left) && IsIntegral(node.binary.right);
+        }
+        break;
+      case PRINT:
+      case ELSE_STATEMENT:
+        ProveIntegers(node.child);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) ProveIntegers(*it);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        ProveIntegers(node.branch.cond);
+        ProveIntegers(node.branch.body);
+        ProveIntegers(node.branch.else_body);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Can evaluating this expression be skipped without any observable difference?
+  bool IsPure(NodeId id) const {
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case NUMBER:
+      case VARIABLE:
+        return true;
+      case UNARY_OPERATION:
+        return IsPure(node.binary.left);
+      case BINARY_OPERATION: {
+        NodeId right = node.binary.right;
+        if (node.op == emplex::Lexer::ID_divide && !(IsNumber(right) && ast[right].value != 0)) return false;
+        if (node.op == emplex::Lexer::ID_modulus && !(IsNumber(right) && !ModulusMayFail(ast[right].value))) return false;
+        return IsPure(node.binary.left) && IsPure(right);
+      }
+      default:
+        return false; // Assignments write, strings print
+    }
+  }
+
+  // Replace stores to unread variables by their value expression.
+  void RemoveDeadStores(NodeId id) {
+    if (id == NO_NODE) return;
+    ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case ASSIGNMENT: {
+        NodeId value = node.assign.value;
+        RemoveDeadStores(value);
+        if (!is_read[node.assign.var]) {
+          if (value == NO_NODE) MakeNumber(id, 0);
+          else ast[id] = ast[value];
+          changed = true;
+        }
+        break;
+      }
+      case UNARY_OPERATION:
+        RemoveDeadStores(node.binary.left);
+        break;
+      case BINARY_OPERATION:
+        RemoveDeadStores(node.binary.left);
+        RemoveDeadStores(node.binary.right);
+        break;
+      case PRINT:
+      case ELSE_STATEMENT:
+        RemoveDeadStores(node.child);
+        break;
+      case STATEMENT_BLOCK:
+        for (NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) RemoveDeadStoreStatement(*it);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        RemoveDeadStores(node.branch.cond);
+        RemoveDeadStoreStatement(node.branch.body);
+        RemoveDeadStoreStatement(node.branch.else_body);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // As RemoveDeadStores, and drop the statement if only a pure expression remains.
+  void RemoveDeadStoreStatement(NodeId id) {
+    if (id == NO_NODE) return;
+    Type type = ast[id].type;
+    RemoveDeadStores(id);
+    bool is_expression = type != PRINT && type != STATEMENT_BLOCK && type != IF_STATEMENT && type != WHILE_LOOP;
+    if (is_expression && IsPure(id)) {
+      MakeEmpty(id);
+      changed = true;
+    }
+  }
+
+  // Remove statements that have become no-ops from every block.
+  void CompactBlocks(NodeId id) {
+    if (id == NO_NODE) return;
+    ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case STATEMENT_BLOCK: {
+        NodeId* out = ast.BlockBegin(id);
+        for (NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) {
+          CompactBlocks(*it);
+          if (!IsEmpty(*it)) *out++ = *it;
+        }
+        node.block.count = static_cast<uint32_t>(out - ast.BlockBegin(id));
+        break;
+      }
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        CompactBlocks(node.branch.body);
+        CompactBlocks(node.branch.else_body);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Record every variable that a statement or expression assigns.
+  void CollectWrites(NodeId id, std::vector<bool>& written) const {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case ASSIGNMENT:
+        written[node.assign.var] = true;
+        CollectWrites(node.assign.value, written);
+        break;
+      case UNARY_OPERATION:
+        CollectWrites(node.binary.left, written);
+        break;
+      case BINARY_OPERATION:
+        CollectWrites(node.binary.left, written);
+        CollectWrites(node.binary.right, written);
+        break;
+      case PRINT:
+      case ELSE_STATEMENT:
+        CollectWrites(node.child, written);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) CollectWrites(*it, written);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        CollectWrites(node.branch.cond, written);
+        CollectWrites(node.branch.body, written);
+        CollectWrites(node.branch.else_body, written);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Does this expression read only variables outside 'written'?  (Temporaries made
+  // after 'written' was filled are set outside the loop.)
+  bool IsInvariant(NodeId id, const std::vector<bool>& written) const {
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case NUMBER:
+        return true;
+      case VARIABLE:
+        return static_cast<size_t>(node.var) >= written.size() || !written[node.var];
+      case UNARY_OPERATION:
+        return IsInvariant(node.binary.left, written);
+      case BINARY_OPERATION:
+        return IsInvariant(node.binary.left, written) && IsInvariant(node.binary.right, written);
+      default:
+        return false;
+    }
+  }
+
+  // Do two expressions compute the same thing?
+  bool Same(NodeId a, NodeId b) const {
+    const ASTNode& x = ast[a];
+    const ASTNode& y = ast[b];
+    if (x.type != y.type || x.op != y.op) return false;
+    switch (x.type) {
+      case NUMBER:
+        return std::memcmp(&x.value, &y.value, sizeof(double)) == 0; // Tells -0 from 0
+      case VARIABLE:
+        return x.var == y.var;
+      case UNARY_OPERATION:
+        return Same(x.binary.left, y.binary.left);
+      case BINARY_OPERATION:
+        return Same(x.binary.left, y.binary.left) && Same(x.binary.right, y.binary.right);
+      default:
+        return false;
+    }
+  }
+
+  // Replace the maximal loop-invariant pure expressions under 'id' by temporaries,
+  // adding the assignments that set them to 'preheader' (one per distinct expression).
+  void Hoist(NodeId id, const std::vector<bool>& written, std::vector<NodeId>& preheader) {
+    if (id == NO_NODE) return;
+    Type type = ast[id].type;
+
+    if ((type == UNARY_OPERATION || type == BINARY_OPERATION) && IsPure(id) && IsInvariant(id, written)) {
+      int temp = -1;
+      for (NodeId assignment : preheader) {
+        if (Same(ast[assignment].assign.value, id)) temp = ast[assignment].assign.var;
+      }
+      if (temp < 0) {
+        temp = NewTemporary();
+        NodeId moved = ast.AddCopy(id);
+        preheader.push_back(ast.AddAssignment(temp, moved, ast[id].token));
+      }
+      ASTNode& node = ast[id];
+      node.type = VARIABLE;
+      node.op = 0;
+      node.var = temp;
+      return;
+    }
+
+    const ASTNode& node = ast[id];
+    switch (type) {
+      case ASSIGNMENT:
+        Hoist(node.assign.value, written, preheader);
+        break;
+      case UNARY_OPERATION:
+        Hoist(node.binary.left, written, preheader);
+        break;
+      case BINARY_OPERATION: {
+        NodeId right = node.binary.right;
+        Hoist(node.binary.left, written, preheader);
+        Hoist(right, written, preheader);
+        break;
+      }
+      case PRINT:
+      case ELSE_STATEMENT:
+        Hoist(node.child, written, preheader);
+        break;
+      case STATEMENT_BLOCK:
+        for (NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) Hoist(*it, written, preheader);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP: {
+        NodeId cond = node.branch.cond, body = node.branch.body, else_body = node.branch.else_body;
+        Hoist(cond, written, preheader);
+        Hoist(body, written, preheader);
+        Hoist(else_body, written, preheader);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // Loop-invariant code motion, outermost loops first so that an expression moves
+  // as far out as it can.  A loop with hoisted expressions becomes a block of the
+  // assignments followed by the loop.
+  void HoistInvariants(NodeId id) {
+    if (id == NO_NODE) return;
+
+    switch (ast[id].type) {
+      case STATEMENT_BLOCK: {
+        std::vector<NodeId> statements(ast.BlockBegin(id), ast.BlockEnd(id)); // AddBlock may move the lists
+        for (NodeId statement : statements) HoistInvariants(statement);
+        break;
+      }
+      case IF_STATEMENT: {
+        NodeId body = ast[id].branch.body, else_body = ast[id].branch.else_body;
+        HoistInvariants(body);
+        HoistInvariants(else_body);
+        break;
+      }
+      case ELSE_STATEMENT:
+        HoistInvariants(ast[id].child);
+        break;
+      case WHILE_LOOP: {
+        std::vector<bool> written(symbols.NumVars(), false);
+        CollectWrites(id, written);
+        std::vector<NodeId> preheader;
+        Hoist(ast[id].branch.cond, written, preheader);
+        Hoist(ast[id].branch.body, written, preheader);
+
+        NodeId body = ast[id].branch.body;
+        if (!preheader.empty()) {
+          preheader.push_back(ast.AddCopy(id));
+          NodeId block = ast.AddBlock(preheader, ast[id].token);
+          ast[id] = ast[block];
+        }
+        HoistInvariants(body);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // A side-effect-free operation inside a statement's expression, in evaluation order
+  struct Occurrence {
+    NodeId id;
+    size_t hash;
+    size_t size;      // Operations in its subtree, itself included
+    bool conditional; // On the right of && or ||, so it may not be evaluated
+  };
+
+  // Post-order walk (which is evaluation order) collecting operations; returns the
+  // structural hash of the subtree.
+  size_t CollectOccurrences(NodeId id, bool conditional, std::vector<Occurrence>& found) {
+    const ASTNode& node = ast[id];
+    size_t hash = static_cast<size_t>(node.type) * 1000003u + node.op;
+    size_t first = found.size();
+
+    switch (node.type) {
+      case NUMBER: {
+        uint64_t bits;
+        std::memcpy(&bits, &node.value, sizeof(bits));
+        return hash * 31 + std::hash<uint64_t>()(bits);
+      }
+      case VARIABLE:
+        return hash * 31 + static_cast<size_t>(node.var);
+      case UNARY_OPERATION:
+        hash = hash * 31 + CollectOccurrences(node.binary.left, conditional, found);
+        break;
+      case BINARY_OPERATION: {
+        bool logic = node.op == emplex::Lexer::ID_and || node.op == emplex::Lexer::ID_or;
+        NodeId right = node.binary.right;
+        hash = hash * 31 + CollectOccurrences(node.binary.left, conditional, found);
+        hash = hash * 31 + CollectOccurrences(right, conditional || logic, found);
+        break;
+      }
+      default:
+        return hash;
+    }
+    found.push_back({id, hash, found.size() - first + 1, conditional});
+    return hash;
+  }
+
+  bool HasAssignment(NodeId id) const {
+    const ASTNode& node = ast[id];
+    switch (node.type) {
+      case ASSIGNMENT:
+        return true;
+      case UNARY_OPERATION:
+        return HasAssignment(node.binary.left);
+      case BINARY_OPERATION:
+        return HasAssignment(node.binary.left) || HasAssignment(node.binary.right);
+      default:
+        return false;
+    }
+  }
+
+  // Common subexpression elimination within one expression without assignments.
+  // The first evaluation of a repeated operation (one that is always evaluated)
+  // stores its value in a temporary, and the later ones read it.  Nothing between
+  // them can change the operands, and an error would already have stopped the
+  // program at the first one.
+  void ShareSubexpressions(NodeId root) {
+    if (root == NO_NODE || HasAssignment(root)) return;
+    std::vector<Occurrence> found;
+    CollectOccurrences(root, false, found);
+    if (found.size() < 2) return;
+
+    std::unordered_map<size_t, std::vector<size_t>> by_hash; // Positions, in evaluation order
+    for (size_t i = 0; i < found.size(); ++i) by_hash[found[i].hash].push_back(i);
+    std::vector<size_t> order(found.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return found[a].size > found[b].size; });
+
+    std::vector<bool> done(found.size(), false); // Handled, or inside an operation that now reads a temporary
+    for (size_t k : order) {
+      if (done[k]) continue;
+      std::vector<size_t> members;
+      for (size_t j : by_hash[found[k].hash]) {
+        // k matches itself; Same() would walk its whole subtree to find out
+        if (!done[j] && (j == k || Same(found[j].id, found[k].id))) members.push_back(j);
+      }
+      for (size_t j : members) done[j] = true;
+
+      auto def = std::find_if(members.begin(), members.end(), [&](size_t j) { return !found[j].conditional; });
+      if (def == members.end() || def + 1 == members.end()) continue;
+
+      int temp = NewTemporary();
+      for (auto use = def + 1; use != members.end(); ++use) {
+        for (size_t inner = *use + 1 - found[*use].size; inner < *use; ++inner) done[inner] = true;
+        ASTNode& node = ast[found[*use].id];
+        node.type = VARIABLE;
+        node.op = 0;
+        node.var = temp;
+      }
+      NodeId moved = ast.AddCopy(found[*def].id);
+      ASTNode& node = ast[found[*def].id];
+      node.type = ASSIGNMENT;
+      node.op = 0;
+      node.assign = {temp, moved};
+    }
+  }
+
+  // ShareSubexpressions over every expression of a statement.
+  void ShareSubexpressionsIn(NodeId id) {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+
+    switch (node.type) {
+      case ASSIGNMENT:
+        ShareSubexpressions(node.assign.value);
+        break;
+      case PRINT:
+        if (ast[node.child].type != STRING) ShareSubexpressions(node.child);
+        break;
+      case ELSE_STATEMENT:
+        ShareSubexpressionsIn(node.child);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) ShareSubexpressionsIn(*it);
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP: {
+        NodeId body = node.branch.body, else_body = node.branch.else_body;
+        ShareSubexpressions(node.branch.cond);
+        ShareSubexpressionsIn(body);
+        ShareSubexpressionsIn(else_body);
+        break;
+      }
+      case UNARY_OPERATION:
+      case BINARY_OPERATION:
+        ShareSubexpressions(id);
+        break;
+      default:
+        break;
+    }
+  }
+
+public:
+  // With 'temporaries', the slots listed there are used again before new ones are
+  // added, which is safe once the statements that used them have finished running.
+  Optimizer(AST& ast, SymbolTable& symbols, std::vector<int>* temporaries = nullptr)
+    : ast(ast), symbols(symbols), temporaries(temporaries) {}
+
+  // 'whole_program' is false when later statements are not known yet (streaming),
+  // in which case no store can be proven dead.
+  void Optimize(std::vector<NodeId>& nodes, bool whole_program = true) {
+    for (NodeId node : nodes) FoldStatement(node);
+    for (NodeId node : nodes) HoistInvariants(node);
+    for (NodeId node : nodes) ShareSubexpressionsIn(node);
+
+    // Dropping one dead store can leave the variables it read unread as well.
+    while (whole_program) {
+      changed = false;
+      is_read.assign(symbols.NumVars(), false);
+      for (NodeId node : nodes) CollectReads(node);
+      for (NodeId node : nodes) RemoveDeadStoreStatement(node);
+      if (!changed) break;
+    }
+
+    std::vector<NodeId> kept;
+    for (NodeId node : nodes) {
+      CompactBlocks(node);
+      if (!IsEmpty(node)) kept.push_back(node);
+    }
+    nodes.swap(kept);
+
+    // Variables start out integral (they are 0 before any store) until a store
+    // says otherwise; the last pass, which changes nothing, leaves the marks final.
+    is_integral.assign(symbols.NumVars(), true);
+    while (whole_program) {
+      changed = false;
+      for (NodeId node : nodes) ProveIntegers(node);
+      if (!changed) break;
+    }
+  }
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "RingBuffer.hpp"
+#include "Utils.hpp"
+
+// Buffered writer for program output.  Text collects in one reusable buffer that
+// is written to the file descriptor when it fills up, on Flush(), and when the
+// Output is destroyed; errors flush it before they are reported.
+//
+// After StartWriter(), full buffers are handed to a writer thread through a
+// lock-free ring instead, so a slow consumer does not stall the interpreter
+// until the ring itself fills up.  An Output made with a string collects the
+// text there instead of writing it anywhere (batch and daemon mode), up to
+// LimitCapture() bytes.
+class Output {
+private:
+  static constexpr size_t CAPACITY = 1 << 16;
+
+  int fd;
+  bool owns_fd = false;
+  std::string* captured = nullptr;  // Receives the text instead of 'fd'
+  size_t capture_limit = SIZE_MAX;  // Most bytes 'captured' may hold
+  std::string buffer;
+  size_t used = 0;
+  size_t room = CAPACITY;           // Bytes of 'buffer' usable before Reserve() looks again
+
+  std::unique_ptr<RingBuffer> ring; // Set while a writer thread is running
+  std::thread writer;
+  std::atomic<uint32_t> wakeups{0}; // Bumped whenever the writer has something new to do
+  std::atomic<bool> stopping{false};
+
+  // Make room for 'count' more bytes and return where they go.
+  char* Reserve(size_t count) {
+    if (used + count > room) {
+      Spill();
+      CheckCapture(count);
+      room = std::min(buffer.size(), Allowed());
+    }
+    return buffer.data() + used;
+  }
+
+  // Bytes that may still be captured once 'buffer' is spilled
+  size_t Allowed() const {
+    if (!captured) return SIZE_MAX;
+    return capture_limit > captured->size() ? capture_limit - captured->size() : 0;
+  }
+
+  // Fail the script before it captures more than LimitCapture() allows
+  void CheckCapture(size_t count) const {
+    if (count > Allowed()) Utils::limit_error("Memory limit exceeded by program output");
+  }
+
+  void WriteAll(const char* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+      ssize_t count = write(fd, data + done, size - done);
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) return; // Output is gone (e.g. closed pipe); drop the rest
+      done += static_cast<size_t>(count);
+    }
+  }
+
+  void Wake() {
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+  }
+
+  // Pass bytes on to the writer thread (waiting while the ring is full), or
+  // write them directly when there is none.
+  void Send(const char* data, size_t size) {
+    if (captured) {
+      captured->append(data, size);
+      return;
+    }
+    if (!ring) {
+      WriteAll(data, size);
+      return;
+    }
+    while (size > 0) {
+      size_t pushed = ring->Push(data, size);
+      data += pushed;
+      size -= pushed;
+      if (pushed > 0) Wake();
+      if (size > 0) ring->WaitForPop();
+    }
+  }
+
+  void Spill() {
+    Send(buffer.data(), used);
+    used = 0;
+  }
+
+  // Body of the writer thread: drain the ring until stopped and empty.
+  void Drain() {
+    while (true) {
+      uint32_t seen = wakeups.load(std::memory_order_acquire);
+      bool stop = stopping.load(std::memory_order_acquire); // Before Front(), so nothing pushed before the stop is missed
+      std::string_view bytes = ring->Front();
+      if (!bytes.empty()) {
+        WriteAll(bytes.data(), bytes.size());
+        ring->Pop(bytes.size());
+      } else if (stop) {
+        return;
+      } else {
+        wakeups.wait(seen, std::memory_order_acquire);
+      }
+    }
+  }
+
+  void StopWriter() {
+    if (!writer.joinable()) return;
+    stopping.store(true, std::memory_order_release);
+    Wake();
+    writer.join();
+    ring.reset();
+  }
+
+public:
+  explicit Output(int fd = STDOUT_FILENO) : fd(fd), buffer(CAPACITY, '\0') {}
+  explicit Output(std::string& captured) : fd(-1), captured(&captured), buffer(CAPACITY, '\0') {}
+  Output(const Output&) = delete;
+  Output& operator=(const Output&) = delete;
+
+  ~Output() {
+    Flush();
+    StopWriter();
+    if (owns_fd) close(fd);
+  }
+
+  // Program output of this process; flushed (and its writer joined) at exit.
+  static Output& Standard() {
+    static Output out(STDOUT_FILENO);
+    return out;
+  }
+
+  // Send all further output to a file, replacing its contents; false if it cannot be opened.
+  bool Open(const std::string& filename) {
+    int file = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) return false;
+    Flush();
+    if (owns_fd) close(fd);
+    fd = file;
+    owns_fd = true;
+    return true;
+  }
+
+  // Hand writes to a background thread through a ring of 'ring_capacity' bytes.
+  void StartWriter(size_t ring_capacity = 1 << 20) {
+    if (ring) return;
+    Flush();
+    ring = std::make_unique<RingBuffer>(ring_capacity);
+    stopping.store(false);
+    writer = std::thread([this] { Drain(); });
+  }
+
+  // Let a capturing Output hold at most 'bytes' of text; writing more throws a
+  // LimitError.  What is already captured counts toward it.
+  void LimitCapture(size_t bytes) {
+    capture_limit = bytes;
+    room = std::min(buffer.size(), Allowed());
+    if (used > room) room = used; // Spilled and checked by the next Reserve()
+  }
+
+  // Write out everything so far; with a writer thread, waits until it has.
+  void Flush() {
+    Spill();
+    while (ring && !ring->Empty()) ring->WaitForPop();
+  }
+
+  void Write(std::string_view text) {
+    if (text.size() > CAPACITY) {
+      Spill();
+      CheckCapture(text.size());
+      Send(text.data(), text.size());
+      return;
+    }
+    text.copy(Reserve(text.size()), text.size());
+    used += text.size();
+  }
+
+  void Put(char c) {
+    *Reserve(1) = c;
+    ++used;
+  }
+
+  // Same text as 'std::cout << value' with the default stream format (%g, precision 6).
+  void WriteNumber(double value) {
+    char* out = Reserve(32);
+    char* end;
+    if (value == std::trunc(value) && std::fabs(value) < 1e6 && !(value == 0 && std::signbit(value))) {
+      // Small integers, by far the most common case, print as plain digits.
+      end = std::to_chars(out, out + 32, static_cast<int32_t>(value)).ptr;
+    } else {
+      end = std::to_chars(out, out + 32, value, std::chars_format::general, 6).ptr;
+    }
+    used += static_cast<size_t>(end - out);
+  }
+};
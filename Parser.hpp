@@ -1,250 +1,240 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <exception>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "lexer.hpp"
 #include "ASTNode.hpp"
+#include "Closures.hpp"
+#include "Compiler.hpp"
+#include "Dependencies.hpp"
+#include "Governor.hpp"
+#include "Jit.hpp"
+#include "Optimizer.hpp"
+#include "Output.hpp"
+#include "Profiler.hpp"
+#include "Stats.hpp"
 #include "Utils.hpp"
+#include "VM.hpp"
 
 using namespace emplex;
 
+// Execution strategy for a parsed program
+enum class Engine {
+  TREE,     // Recursive AST::Run
+  BYTECODE, // Compile to bytecode and run on the VM
+  CLOSURE   // Compile to a tree of specialized closures and call it
+};
+
+// How Parse() should prepare and execute the program
+struct RunOptions {
+  Engine engine = Engine::BYTECODE;
+  bool optimize = true;         // Run the Optimizer over the AST before executing it
+  bool streaming = false;       // Execute each top-level statement as soon as it is parsed
+  RunStats* stats = nullptr;    // If set, receives timings, counts and sizes of the run
+  Profile* profile = nullptr;   // If set, receives per-line costs (bytecode engine only)
+  bool jit = true;              // Compile statements with while loops to native code (not with profile)
+  Limits limits;                // Steps, time and memory the run may use; exceeding them throws LimitError
+  unsigned threads = 1;         // Run independent top-level statements on up to this many threads
+                                // (not with the tree engine, a profile or limits; stats do not
+                                // count what runs this way)
+};
+
 class Parser {
 private:
-  std::vector<emplex::Token> tokens;
-  int token_id = 0;
+  std::string source_buffer;          // Owns the source text when read from a stream
+  std::string_view source;            // Source text; tokens are views into it
   SymbolTable table;
+  TokenBuffer tokens{source, &table.Names()}; // Lexed on demand; EOF past the end of the input
+  int token_id = 0;
+  Output& out;             // Program output of PRINT statements
+  Governor governor;       // Enforces RunOptions::limits on the current run
+  AST ast{tokens, source, out}; // Owns every node; released together with the Parser
+  std::vector<NodeId> prepared;       // Top-level statements kept by Prepare()
+  std::vector<double> initial_values; // Variable slots as Prepare() left them
+
+  static std::string ReadAll(std::istream& in) {
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return std::move(contents).str();
+  }
+
+  static double ParseNumber(std::string_view lexeme) {
+    double value = 0;
+    auto [end, error] = std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+    if (error == std::errc::result_out_of_range) value = HUGE_VAL;
+    return value;
+  }
 
   // Parses an assignment statement (e.g., var x = expr;)
-  ASTNode* parseAssignment() {
+  NodeId parseAssignment() {
     ++token_id;
-    ASTNode* node = new ASTNode(Type::ASSIGNMENT);
 
     // Ensure the current token is an identifier
-    if (token_id >= tokens.size() || tokens[token_id] != Lexer::ID_identifier) {
-      Utils::error("Expected identifier", tokens[token_id]);
+    if (!tokens.Has(token_id) || tokens[token_id] != Lexer::ID_identifier) {
+      Utils::error("Expected identifier", tokens[token_id], source);
     }
-    std::string identifier = tokens[token_id].lexeme;
+    Symbol identifier = tokens.SymbolAt(token_id);
 
     // Check if the variable is already defined in the current scope
     if (table.HasVarInCurrentScope(identifier)) {
-      Utils::error("Tried to redefine variable", tokens[token_id]);
+      Utils::error("Tried to redefine variable", tokens[token_id], source);
     }
 
     int unique_id = table.InitializeVar(identifier);
-    node->SetLeft(new ASTNode(Type::VARIABLE, unique_id));
+    uint32_t identifier_token = token_id;
     ++token_id;
 
     // Handle variable declaration without assignment (e.g., var x;)
-    if (token_id < tokens.size() && tokens[token_id] == Lexer::ID_semicolon) {
+    if (tokens.Has(token_id) && tokens[token_id] == Lexer::ID_semicolon) {
       ++token_id;
-      return node;
+      return ast.AddAssignment(unique_id, NO_NODE, identifier_token);
     }
 
     // Ensure the next token is the assignment operator '='
-    if (token_id >= tokens.size() || tokens[token_id] != Lexer::ID_assignment) {
-      Utils::error("Expected assignment operator", tokens[token_id]);
+    if (!tokens.Has(token_id) || tokens[token_id] != Lexer::ID_assignment) {
+      Utils::error("Expected assignment operator", tokens[token_id], source);
     }
     ++token_id;
 
     // Parse the right-hand side expression
-    ASTNode* right = parseExpression();
+    NodeId right = parseExpression();
 
     // Ensure the statement ends with a semicolon
-    if (token_id >= tokens.size() || tokens[token_id] != Lexer::ID_semicolon) {
-      Utils::error("Expected semicolon at end of statement", tokens[token_id]);
+    if (!tokens.Has(token_id) || tokens[token_id] != Lexer::ID_semicolon) {
+      Utils::error("Expected semicolon at end of statement", tokens[token_id], source);
     }
     ++token_id;
 
-    node->SetRight(right);
-    return node;
+    return ast.AddAssignment(unique_id, right, identifier_token);
   }
 
-  // Parses logical expressions (e.g., a && b || c)
-  ASTNode* parseLogical() {
-    ASTNode* node = parseComparison();
-    while (token_id < tokens.size() && 
-          (tokens[token_id].id == Lexer::ID_and || 
-           tokens[token_id].id == Lexer::ID_or)) {
-      emplex::Token logical_op = tokens[token_id];
+  // Binding strength of binary operators, by token id (0: not a binary operator).
+  // && and || share the loosest level; ** is the only right-associative one.
+  enum Level : uint8_t { NONE, LOGICAL, COMPARISON, SUM, PRODUCT, POWER };
+  static constexpr std::array<uint8_t, 256> LEVELS = [] {
+    std::array<uint8_t, 256> levels{};
+    for (int id : {Lexer::ID_and, Lexer::ID_or}) levels[id] = LOGICAL;
+    for (int id : {Lexer::ID_equality, Lexer::ID_not_eq, Lexer::ID_greater_than, Lexer::ID_greater_or_eq,
+                   Lexer::ID_less_than, Lexer::ID_less_or_eq})
+      levels[id] = COMPARISON;
+    for (int id : {Lexer::ID_add, Lexer::ID_negation}) levels[id] = SUM;
+    for (int id : {Lexer::ID_multiply, Lexer::ID_divide, Lexer::ID_modulus}) levels[id] = PRODUCT;
+    levels[Lexer::ID_exponent] = POWER;
+    return levels;
+  }();
+
+  // Parses logical expressions (e.g., a && b || c), the loosest kind
+  NodeId parseLogical() { return parseBinary(LOGICAL); }
+
+  // Parses sums and anything binding tighter (e.g., a + b * c), but no comparisons
+  NodeId parseExpression() { return parseBinary(SUM); }
+
+  // Precedence climbing: a primary expression followed by binary operators of at
+  // least 'min_level', each taking as its right operand everything that binds
+  // tighter than itself (or as tight, for right-associative **).  Builds the
+  // same nodes, in the same order, as one function per level would.
+  NodeId parseBinary(uint8_t min_level) {
+    NodeId node = parsePrimary();
+    bool compared = false; // Comparisons do not chain (a < b < c)
+    while (true) {
+      uint8_t level = LEVELS[static_cast<uint8_t>(tokens[token_id].id)];
+      if (level < min_level || level == NONE) return node;
+      uint32_t binary_op = token_id;
       ++token_id;
-      ASTNode* right_node = parseComparison();
-      ASTNode* logical_op_node = new ASTNode(BINARY_OPERATION, logical_op);
-      logical_op_node->SetLeft(node);
-      logical_op_node->SetRight(right_node);
-      node = logical_op_node;
-    }
-    return node;
-  }
-
-  // Parses comparison expressions (e.g., a == b, a < b)
-  ASTNode* parseComparison(bool singleLineStatement = false) {
-    int binary_node_count = 0;
-
-    ASTNode* node;
-    if (singleLineStatement) {
-      token_id++;
-      auto varNode = parseIdentifier(true);
-    }
-    else {
-      node = parseExpression();
-    }
-
-    while (token_id < tokens.size() &&
-          (tokens[token_id].id == Lexer::ID_equality || 
-           tokens[token_id].id == Lexer::ID_not_eq || 
-           tokens[token_id].id == Lexer::ID_greater_than || 
-           tokens[token_id].id == Lexer::ID_greater_or_eq || 
-           tokens[token_id].id == Lexer::ID_less_than || 
-           tokens[token_id].id == Lexer::ID_less_or_eq)) {
-      emplex::Token binary_op = tokens[token_id];
-      ++token_id;
-      ASTNode* right_node = parseExpression();
-      
-      ASTNode* binary_op_node = new ASTNode(BINARY_OPERATION, binary_op);
-      binary_node_count++;
-
-      if (binary_node_count > 1) {
-        Utils::error("Comparisons should be non-associative.", tokens[token_id]);
+      NodeId right_node = parseBinary(level == POWER ? POWER : level + 1);
+      if (level == COMPARISON) {
+        if (compared) Utils::error("Comparisons should be non-associative.", tokens[token_id], source);
+        compared = true;
       }
-
-      binary_op_node->SetLeft(node);
-      binary_op_node->SetRight(right_node);
-      node = binary_op_node;
+      node = ast.AddBinary(node, right_node, binary_op);
     }
-    return node;
-  }
-
-  // Parses addition and subtraction expressions (e.g., a + b - c)
-  ASTNode* parseExpression() {
-    ASTNode* node = parseTerm();
-    while (token_id < tokens.size() && 
-          (tokens[token_id].id == Lexer::ID_add || 
-           tokens[token_id].id == Lexer::ID_negation)) {
-      emplex::Token binary_op = tokens[token_id];
-      ++token_id;
-      ASTNode* right_node = parseTerm();
-      ASTNode* binary_op_node = new ASTNode(BINARY_OPERATION, binary_op);
-      binary_op_node->SetLeft(node);
-      binary_op_node->SetRight(right_node);
-      node = binary_op_node;
-    }
-    return node;
-  }
-
-  // Parses multiplication, division, and modulus expressions (e.g., a * b / c % d)
-  ASTNode* parseTerm() {
-    ASTNode* node = parseFactor();
-    while (token_id < tokens.size() && 
-          (tokens[token_id].id == Lexer::ID_multiply || 
-           tokens[token_id].id == Lexer::ID_divide ||
-           tokens[token_id].id == Lexer::ID_modulus)) {
-      emplex::Token binary_op = tokens[token_id];
-      ++token_id;
-      ASTNode* right_node = parseFactor();
-      ASTNode* binary_op_node = new ASTNode(BINARY_OPERATION, binary_op);
-      binary_op_node->SetLeft(node);
-      binary_op_node->SetRight(right_node);
-      node = binary_op_node;
-    }
-    return node;
-  }
-
-  // Parses exponentiation expressions (e.g., a ^ b)
-  ASTNode* parseFactor() {
-    ASTNode* node = parsePrimary();
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_exponent) {
-      emplex::Token binary_op = tokens[token_id];
-      ++token_id;
-      ASTNode* right_node = parseFactor();
-      ASTNode* binary_op_node = new ASTNode(BINARY_OPERATION, binary_op);
-      binary_op_node->SetLeft(node);
-      binary_op_node->SetRight(right_node);
-      node = binary_op_node;
-    }
-    return node;
   }
 
   // Parses primary expressions such as literals, variables, and parentheses
-  ASTNode* parsePrimary() {
+  NodeId parsePrimary() {
     // Handle unary negation
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_negation) {
-      emplex::Token negation_token = tokens[token_id];
+    if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_negation) {
+      uint32_t negation_token = token_id;
       ++token_id;
-      ASTNode* operand = parsePrimary();
-      ASTNode* negation_node = new ASTNode(UNARY_OPERATION, negation_token);
-      negation_node->SetLeft(operand);
-      return negation_node;
+      NodeId operand = parsePrimary();
+      return ast.AddUnary(operand, negation_token);
     }
 
     // Handle logical NOT
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_not) {
-      emplex::Token not_token = tokens[token_id];
+    if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_not) {
+      uint32_t not_token = token_id;
       ++token_id;
-      ASTNode* operand = parsePrimary();
-      ASTNode* not_node = new ASTNode(UNARY_OPERATION, not_token);
-      not_node->SetLeft(operand);
-      return not_node;
+      NodeId operand = parsePrimary();
+      return ast.AddUnary(operand, not_token);
     }
 
     // Handle string literals
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_string) {
-      emplex::Token string_token = tokens[token_id];
-      ++token_id;
-      std::string stripped_string = string_token.lexeme.substr(1, string_token.lexeme.size() - 2);
-      return new ASTNode(STRING, stripped_string);
+    if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_string) {
+      const emplex::Token& string_token = tokens[token_id];
+      std::string stripped_string(string_token.lexeme.substr(1, string_token.lexeme.size() - 2));
+      return ast.AddString({{stripped_string}}, token_id++);
     }
 
     // Handle variables and assignments
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_identifier) {
-      int unique_id = table.GetUniqueId(tokens[token_id].lexeme);
+    if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_identifier) {
+      int unique_id = table.GetUniqueId(tokens.SymbolAt(token_id));
+      uint32_t identifier_token = token_id;
       ++token_id;
 
       // Handle assignment within expressions (e.g., x = expr)
-      if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_assignment) {
+      if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_assignment) {
         ++token_id;
-        ASTNode* assignment_expr = parseExpression();
-        ASTNode* assignment_node = new ASTNode(ASSIGNMENT);
-        assignment_node->SetLeft(new ASTNode(VARIABLE, unique_id));
-        assignment_node->SetRight(assignment_expr);
-        return assignment_node;
+        NodeId assignment_expr = parseExpression();
+        return ast.AddAssignment(unique_id, assignment_expr, identifier_token);
       }
-      return new ASTNode(VARIABLE, unique_id);
+      return ast.AddVariable(unique_id, identifier_token);
     }
 
     // Handle numeric literals
-    if (token_id < tokens.size() && 
+    if (tokens.Has(token_id) && 
        (tokens[token_id].id == Lexer::ID_integer || tokens[token_id].id == Lexer::ID_float)) {
       ++token_id;
-      return new ASTNode(NUMBER, std::stod(tokens[token_id - 1].lexeme));
+      return ast.AddNumber(ParseNumber(tokens[token_id - 1].lexeme), token_id - 1);
     }
 
     // Handle parentheses (e.g., (expr))
-    if (token_id < tokens.size() && tokens[token_id].id == Lexer::ID_open_parenthesis) {
+    if (tokens.Has(token_id) && tokens[token_id].id == Lexer::ID_open_parenthesis) {
       ++token_id;
-      ASTNode* node = parseExpression();
+      NodeId node = parseExpression();
       if (tokens[token_id].id != Lexer::ID_close_parenthesis) {
-        Utils::error("Expected closing parenthesis", tokens[token_id]);
+        Utils::error("Expected closing parenthesis", tokens[token_id], source);
       }
       ++token_id;
       return node;
     }
 
-    Utils::error("Unexpected token", tokens[token_id]);
-    return nullptr;
+    Utils::error("Unexpected token", tokens[token_id], source);
+    return NO_NODE;
   }
 
   // Parses a block of statements inside braces (e.g., { statements })
-  ASTNode* parseBlock() {
+  NodeId parseBlock() {
     if (tokens[token_id].id != Lexer::ID_open_brace) {
-      Utils::error("Expected { at the start of block", tokens[token_id]);
+      Utils::error("Expected { at the start of block", tokens[token_id], source);
     }
+    uint32_t block_token = token_id;
     ++token_id;
 
     table.PushScope();
 
-    std::vector<ASTNode*> blockStatements;
-    while (token_id < tokens.size() && tokens[token_id].id != Lexer::ID_close_brace) {
+    std::vector<NodeId> blockStatements;
+    while (tokens.Has(token_id) && tokens[token_id].id != Lexer::ID_close_brace) {
       switch (tokens[token_id].id) {
         case Lexer::ID_var:
           blockStatements.push_back(parseAssignment());
@@ -262,27 +252,26 @@ private:
           blockStatements.push_back(parseWhile());
           break;
         default:
-          Utils::error("Unexpected token in block", tokens[token_id]);
+          Utils::error("Unexpected token in block", tokens[token_id], source);
           break;
       }
     }
 
     if (tokens[token_id].id != Lexer::ID_close_brace) {
-      Utils::error("Expected } at the end of block", tokens[token_id]);
+      Utils::error("Expected } at the end of block", tokens[token_id], source);
     }
     ++token_id;
 
-    ASTNode* blockNode = new ASTNode(STATEMENT_BLOCK);
-    blockNode->SetBlockStatements(blockStatements);
+    NodeId blockNode = ast.AddBlock(blockStatements, block_token);
 
     table.PopScope();
     return blockNode;
   }
 
-  ASTNode* parseSingleLine() {
+  NodeId parseSingleLine() {
 
-    ASTNode* statement;
-    if (token_id < tokens.size() && tokens[token_id].id != Lexer::ID_semicolon) {
+    NodeId statement = NO_NODE;
+    if (tokens.Has(token_id) && tokens[token_id].id != Lexer::ID_semicolon) {
       switch (tokens[token_id].id) {
         case Lexer::ID_var:
           statement = parseAssignment();
@@ -294,7 +283,7 @@ private:
           statement = parsePrint();
           break;
         default:
-          Utils::error("Unexpected token in block", tokens[token_id]);
+          Utils::error("Unexpected token in block", tokens[token_id], source);
           break;
       }
     }
@@ -302,20 +291,18 @@ private:
     return statement;
   }
 
-  ASTNode* parseIf() {
+  NodeId parseIf() {
     if (tokens[token_id + 1].id != Lexer::ID_open_parenthesis) {
-      Utils::error("Expected ( at the start of condition", tokens[token_id]);
+      Utils::error("Expected ( at the start of condition", tokens[token_id], source);
     }
-    auto if_token = tokens[token_id];
-    ASTNode* if_node = new ASTNode(IF_STATEMENT, if_token);
+    uint32_t if_token = token_id;
 
     token_id += 2; // move onto the start of the condition block
 
     auto conditional = parseLogical();
-    if_node->SetLeft(conditional);
 
     token_id++; // go to beginning of statement token
-    ASTNode* statement_node;
+    NodeId statement_node;
 
     if (tokens[token_id].id != Lexer::ID_open_brace) {
       statement_node = parseSingleLine(); // no block, just single line
@@ -324,20 +311,18 @@ private:
       statement_node = parseBlock(); // typical block parsing
     }
 
-    if_node->SetRight(statement_node);
-
+    NodeId else_node = NO_NODE;
     if (tokens[token_id].id == Lexer::ID_else) // possible 'else' condition
     {
-      auto else_node = parseElse();
-      if_node->SetElseBlock(else_node);
+      else_node = parseElse();
     }
 
-    return if_node;
+    return ast.AddIf(conditional, statement_node, else_node, if_token);
   }
 
-  ASTNode* parseElse() {
+  NodeId parseElse() {
       token_id++;
-      ASTNode* statement_node;
+      NodeId statement_node;
       
       if (tokens[token_id].id != Lexer::ID_open_brace) {
         statement_node = parseSingleLine(); // no block, just single line
@@ -349,10 +334,10 @@ private:
       return statement_node;
   }
 
-  ASTNode* parseSingleLineLoop() {
+  NodeId parseSingleLineLoop() {
 
-    ASTNode* statement;
-    if (token_id < tokens.size() && tokens[token_id].id != Lexer::ID_open_parenthesis) {
+    NodeId statement = NO_NODE;
+    if (tokens.Has(token_id) && tokens[token_id].id != Lexer::ID_open_parenthesis) {
       switch (tokens[token_id].id) {
         case Lexer::ID_var:
           statement = parseAssignment();
@@ -364,7 +349,7 @@ private:
           statement = parsePrint();
           break;
         default:
-          Utils::error("Unexpected token in block", tokens[token_id]);
+          Utils::error("Unexpected token in block", tokens[token_id], source);
           break;
       }
     }
@@ -372,17 +357,17 @@ private:
     return statement;
   }
 
-  ASTNode* parseWhile() {
+  NodeId parseWhile() {
     if (tokens[token_id + 1].id != Lexer::ID_open_parenthesis) {
-      Utils::error("Expected ( at the start of condition", tokens[token_id]);
+      Utils::error("Expected ( at the start of condition", tokens[token_id], source);
     }
 
-    auto while_token = tokens[token_id];
-    ASTNode* while_node = new ASTNode(WHILE_LOOP, while_token);
+    uint32_t while_token = token_id;
+    NodeId conditional = NO_NODE;
+    NodeId statement_node = NO_NODE;
 
     token_id += 2; // move onto the start of the condition block
 
-    ASTNode* conditional;
     // single line while loop
     // my idea is to evaluate the assignment first, run it and get its result right here, and then do the comparison
     // now that I'm writing this down, I don't think it'll work because the comparison operator depends on two nodes to compare with
@@ -393,14 +378,15 @@ private:
       token_id++;
       auto varNode = parseIdentifier(true);
 
+      // Not supported yet: the loop has no usable condition, so report the token
+      // that follows the assignment now rather than ever executing this node.
+      Utils::error("[Parse loop] Unexpected token", tokens[token_id], source);
     }
     // normal setup of while loop
     else {
-      conditional = parseLogical();
-      while_node->SetLeft(conditional); // left child node will be conditional to evaluate every iteration
+      conditional = parseLogical(); // conditional to evaluate every iteration
 
       token_id++; // go to beginning of statement token
-      ASTNode* statement_node;
 
       // parse single line or statement block?
       if (tokens[token_id].id != Lexer::ID_open_brace) {
@@ -409,9 +395,6 @@ private:
       else {
         statement_node = parseBlock();
       }
-      
-
-      while_node->SetRight(statement_node);
     }
     
     // while_node->SetLeft(conditional); // left child node will be conditional to evaluate every iteration
@@ -436,133 +419,506 @@ private:
 
     // while_node->SetRight(statement_node);
 
-    return while_node;
+    return ast.AddWhile(conditional, statement_node, while_token);
   }
 
 public:
   // Constructor: initialize the parser with tokens from an input file
-  Parser(std::ifstream& in_file) {
-    Lexer lexer;
-    tokens = lexer.Tokenize(in_file);
-  }
+  Parser(std::istream& in_file, Output& out = Output::Standard())
+    : source_buffer(ReadAll(in_file)), source(source_buffer), out(out) {}
+
+  // Constructor: parse source text that stays valid for the Parser's lifetime
+  Parser(std::string_view source, Output& out = Output::Standard()) : source(source), out(out) {}
+
   void print_tokens()
   {
-    for (auto token : tokens)
-      std::cout << token.lexeme << " ";
+    for (size_t i = 0; tokens.Has(i); ++i)
+      std::cout << tokens[i].lexeme << " ";
+  }
+
+  // Parses one top-level statement
+  NodeId parseStatement() {
+    switch (tokens[token_id].id) {
+      case Lexer::ID_var:
+        return parseAssignment();
+      case Lexer::ID_identifier:
+        return parseIdentifier();
+      case Lexer::ID_print:
+        return parsePrint();
+      case Lexer::ID_open_brace:
+        return parseBlock();
+      case Lexer::ID_if:
+        return parseIf();
+      case Lexer::ID_while:
+        return parseWhile();
+      default:
+        Utils::error("[Parse loop] Unexpected token", tokens[token_id], source);
+        return NO_NODE;
+    }
   }
+
   // Main parsing function that builds and executes the AST
-  void Parse() {
-    std::vector<ASTNode*> nodes;
-    while (token_id < tokens.size()) {
-      switch (tokens[token_id].id) {
-        case Lexer::ID_var:
-          nodes.push_back(parseAssignment());
-          break;
-        case Lexer::ID_identifier:
-          nodes.push_back(parseIdentifier());
-          break;
-        case Lexer::ID_print:
-          nodes.push_back(parsePrint());
-          break;
-        case Lexer::ID_open_brace:
-          nodes.push_back(parseBlock());
-          break;
-        case Lexer::ID_if:
-          nodes.push_back(parseIf());
-          break;
-        case Lexer::ID_while:
-          nodes.push_back(parseWhile());
-          break;
-        default:
-          Utils::error("[Parse loop] Unexpected token", tokens[token_id]);
-          break;
+  void Parse(const RunOptions& options = {}) {
+    StartGovernor(options);
+    if (options.streaming) {
+      ParseStreaming(options);
+      return;
+    }
+
+    PhaseClock clock(options.stats);
+    std::vector<NodeId> nodes = ParseAll(options, clock);
+    Engines engines(ast, table, out);
+    Execute(engines, nodes, options, clock);
+  }
+
+  // Lex, parse and optimize the whole program without running it, so that
+  // RunPrepared() can run it any number of times (daemon mode).
+  void Prepare(const RunOptions& options = {}) {
+    StartGovernor(options);
+    PhaseClock clock(options.stats);
+    prepared = ParseAll(options, clock);
+    initial_values = table.SaveValues();
+  }
+
+  // Run the program from Prepare() with every variable back at its initial value,
+  // as if it had just been parsed.
+  void RunPrepared(const RunOptions& options = {}) {
+    StartGovernor(options);
+    table.RestoreValues(initial_values);
+    PhaseClock clock(options.stats);
+    Engines engines(ast, table, out);
+    Execute(engines, prepared, options, clock);
+  }
+
+  // Write the program from Prepare() to 'image': its variable slots, top-level
+  // statements and AST.  Tokens are left out.
+  void SaveImage(ImageWriter& image) const {
+    image.PutArray(initial_values);
+    image.PutArray(prepared);
+    ast.Save(image);
+  }
+
+  // Take the program from an image written by SaveImage() instead of Prepare().
+  // Nothing gets lexed unless an error message needs a token.  False if the
+  // image is damaged.
+  bool LoadImage(ImageReader& image) {
+    if (!image.GetArray(initial_values) || !image.GetArray(prepared) || !ast.Load(image) || !image.AtEnd()) {
+      ast.Clear(); // Leave the Parser as it was, to parse the source instead
+      prepared.clear();
+      return false;
+    }
+    table.RestoreValues(initial_values);
+    return true;
+  }
+
+  // Lex and parse every statement, then optimize them; returns the top-level nodes.
+  std::vector<NodeId> ParseAll(const RunOptions& options, PhaseClock& clock) {
+    tokens.LexAll();
+    clock.Lap(&PhaseTimes::lex);
+
+    std::vector<NodeId> nodes;
+    while (tokens.Has(token_id)) {
+      nodes.push_back(parseStatement());
+      CheckParsing(nodes.back(), nodes.size());
+    }
+    if (!nodes.empty()) CheckParsing(nodes.back(), 0);
+    clock.Lap(&PhaseTimes::parse);
+    RecordParsed(options.stats);
+    if (options.stats) options.stats->symbol_bytes = table.Bytes();
+
+    if (options.optimize) {
+      Optimizer(ast, table).Optimize(nodes);
+      clock.Lap(&PhaseTimes::optimize);
+    }
+    return nodes;
+  }
+
+  // Start counting a run against 'options.limits'; the engines count loop
+  // iterations only if it has any.
+  void StartGovernor(const RunOptions& options) {
+    governor = Governor(options.limits);
+    ast.SetGovernor(governor.Active() ? &governor : nullptr);
+  }
+
+  // Check time and memory every so many statements parsed (only with limits)
+  void CheckParsing(NodeId node, size_t parsed) {
+    if (!governor.Active() || parsed % 1024 != 0) return;
+    governor.CheckTime(ast.GetToken(node), source);
+    governor.CheckMemory(ProgramBytes(), ast.GetToken(node), source);
+  }
+
+  size_t ProgramBytes() const { return tokens.Bytes() + ast.Bytes() + table.Bytes(); }
+
+  // Output captured in memory (batch and daemon mode) gets what the memory
+  // limit leaves over after the program itself
+  void LimitOutput(const RunOptions& options) {
+    size_t limit = options.limits.memory;
+    if (limit) out.LimitCapture(limit - std::min(limit, ProgramBytes()));
+  }
+
+  // Record what parsing produced; when streaming, counts add up and sizes keep their peak.
+  void RecordParsed(RunStats* stats) {
+    if (!stats) return;
+    stats->tokens = tokens.size();
+    ast.CountTypes(stats->parsed.data());
+    stats->token_bytes = std::max(stats->token_bytes, tokens.Bytes());
+    stats->ast_bytes = std::max(stats->ast_bytes, ast.Bytes());
+  }
+
+  // Everything that executes statements, kept across calls when streaming
+  struct Engines {
+    Chunk chunk;
+    Compiler compiler;
+    ClosureProgram closures;
+    Jit jit;
+
+    Engines(const AST& ast, SymbolTable& table, Output& out)
+      : compiler(chunk, ast, table), closures(ast, table, out), jit(ast, table, out) {}
+  };
+
+  // Run top-level statements, in order or (with several threads) independent ones
+  // at the same time.
+  void Execute(Engines& engines, const std::vector<NodeId>& nodes, const RunOptions& options, PhaseClock& clock) {
+    LimitOutput(options);
+    if (options.threads > 1 && nodes.size() > 1 && options.engine != Engine::TREE && !options.profile &&
+        !ast.GetGovernor()) {
+      ExecuteParallel(engines, nodes, options, clock);
+      return;
+    }
+    ExecuteInOrder(engines, nodes, options, clock);
+  }
+
+  // Run top-level statements in order.  With the JIT on, statements that contain a
+  // while loop run as native code when it can compile them; everything else goes to
+  // the selected engine.
+  void ExecuteInOrder(Engines& engines, const std::vector<NodeId>& nodes, const RunOptions& options,
+                      PhaseClock& clock) {
+    if (!options.jit || options.profile) {
+      RunEngine(engines, nodes, options, clock);
+      return;
+    }
+
+    std::vector<NodeId> pending;
+    for (NodeId node : nodes) {
+      if (!Jit::HasLoop(ast, node)) {
+        pending.push_back(node);
+        continue;
       }
+      NativeCode native = engines.jit.Compile(node);
+      clock.Lap(&PhaseTimes::compile);
+      if (!native) {
+        pending.push_back(node);
+        continue;
+      }
+      RunEngine(engines, pending, options, clock);
+      pending.clear();
+      engines.jit.Run(native);
+      clock.Lap(&PhaseTimes::execute);
     }
+    RunEngine(engines, pending, options, clock);
+  }
 
-    // Execute parsed nodes
-    for (auto node : nodes) {
-      node->Run(table);
+  // Statements of one group compiled ahead of a parallel run, with their own
+  // engines and output.  Each statement's output is kept apart (it ends at
+  // 'ends[i]' in 'text') so that it can be emitted in program order.
+  struct Task {
+    struct Step {
+      NodeId node;
+      NativeCode native;
+      Chunk chunk;
+      std::unique_ptr<ClosureProgram> closures;
+    };
+
+    std::vector<size_t> statements; // Indices into the phase, in order
+    std::vector<Step> steps;
+    std::string text;
+    Output out{text};
+    Jit jit;
+    Chunk chunk;
+    Compiler compiler;
+    std::vector<size_t> ends;
+    std::exception_ptr error; // Stopped the last statement that ran
+
+    Task(const AST& ast, SymbolTable& table) : jit(ast, table, out), compiler(chunk, ast, table) {}
+
+    // Compile every statement up front: bytecode adds constant and temporary
+    // slots, which must not move while other threads run.
+    void Compile(const AST& ast, SymbolTable& table, const RunOptions& options) {
+      for (Step& step : steps) {
+        if (options.jit && Jit::HasLoop(ast, step.node)) step.native = jit.Compile(step.node);
+        if (step.native) continue;
+        if (options.engine == Engine::BYTECODE) {
+          compiler.Compile({step.node});
+          step.chunk = std::move(chunk);
+          chunk.Clear();
+        } else {
+          step.closures = std::make_unique<ClosureProgram>(ast, table, out);
+          step.closures->Compile({step.node});
+        }
+      }
+    }
+
+    void Run(const AST& ast, SymbolTable& table) {
+      try {
+        for (const Step& step : steps) {
+          if (step.native) jit.Run(step.native);
+          else if (step.closures) step.closures->Run();
+          else VM(step.chunk, ast, table, out).Run();
+          out.Flush();
+          ends.push_back(text.size());
+        }
+      } catch (...) {
+        error = std::current_exception();
+        out.Flush();
+        ends.push_back(text.size()); // What the failed statement printed still comes out
+      }
+    }
+  };
+
+  // Run statements with no data dependencies between them on several threads,
+  // then emit their output in program order, so that it is byte-identical to
+  // running them in order.  Statements split into phases of independent groups:
+  // a new phase starts at a statement that ties together two groups with loops,
+  // and after a statement that may fail at run time, so nothing runs that such
+  // an error would have prevented.  Phases with fewer than two loops to overlap
+  // run in order.  Output of a statement stays buffered until every statement
+  // of its phase is done.
+  void ExecuteParallel(Engines& engines, const std::vector<NodeId>& nodes, const RunOptions& options,
+                       PhaseClock& clock) {
+    if (std::count_if(nodes.begin(), nodes.end(), [&](NodeId node) { return Jit::HasLoop(ast, node); }) < 2) {
+      ExecuteInOrder(engines, nodes, options, clock); // Nothing worth overlapping
+      return;
+    }
+    auto slice = [&](size_t begin, size_t end) {
+      return std::vector<NodeId>(nodes.begin() + begin, nodes.begin() + end);
+    };
+    Dependencies dependencies(ast);
+    StatementGroups groups;
+    size_t done = 0;  // Statements before this one have run
+    size_t start = 0; // First statement of the current phase
+    auto end_phase = [&](size_t end) {
+      std::vector<bool> looping;
+      std::vector<std::vector<size_t>> independent = groups.Groups(looping);
+      if (std::count(looping.begin(), looping.end(), true) >= 2) {
+        ExecuteInOrder(engines, slice(done, start), options, clock);
+        RunPhase(slice(start, end), independent, looping, options, clock);
+        done = end;
+      }
+      groups = StatementGroups();
+      start = end;
+    };
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      StatementAccess access = dependencies.Analyze(nodes[i]);
+      if (groups.JoinsLoops(access)) end_phase(i); // Wait for both loops
+      groups.Add(access);
+      if (access.may_fail) end_phase(i + 1);
+    }
+    end_phase(nodes.size());
+    ExecuteInOrder(engines, slice(done, nodes.size()), options, clock);
+  }
+
+  // Run one phase: each group with a loop as a task of its own, and the groups
+  // without (cheap, and independent of everything else) together in one more.
+  void RunPhase(const std::vector<NodeId>& nodes, std::vector<std::vector<size_t>>& independent,
+                const std::vector<bool>& looping, const RunOptions& options, PhaseClock& clock) {
+    std::vector<std::unique_ptr<Task>> tasks;
+    std::vector<size_t> light; // Statements of groups without loops
+    for (size_t g = 0; g < independent.size(); ++g) {
+      if (!looping[g]) {
+        light.insert(light.end(), independent[g].begin(), independent[g].end());
+        continue;
+      }
+      tasks.push_back(std::make_unique<Task>(ast, table));
+      tasks.back()->statements = std::move(independent[g]);
+    }
+    if (!light.empty()) {
+      std::sort(light.begin(), light.end());
+      tasks.push_back(std::make_unique<Task>(ast, table));
+      tasks.back()->statements = std::move(light);
+    }
+
+    std::vector<std::pair<size_t, size_t>> where(nodes.size()); // Task and step of each statement
+    for (size_t t = 0; t < tasks.size(); ++t) {
+      for (size_t i : tasks[t]->statements) {
+        where[i] = {t, tasks[t]->steps.size()};
+        tasks[t]->steps.push_back({nodes[i], {}, {}, {}});
+      }
+      tasks[t]->Compile(ast, table, options);
+    }
+    clock.Lap(&PhaseTimes::compile);
+
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+      for (size_t t; (t = next.fetch_add(1)) < tasks.size();) tasks[t]->Run(ast, table);
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(options.threads, tasks.size()); ++i) workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers) worker.join();
+
+    for (const auto& [t, step] : where) {
+      const Task& task = *tasks[t];
+      if (step >= task.ends.size()) continue; // Not reached: an earlier statement failed
+      size_t begin = step == 0 ? 0 : task.ends[step - 1];
+      out.Write(std::string_view(task.text).substr(begin, task.ends[step] - begin));
+      if (step + 1 == task.ends.size() && task.error) std::rethrow_exception(task.error);
+    }
+    clock.Lap(&PhaseTimes::execute);
+  }
+
+  void RunEngine(Engines& engines, const std::vector<NodeId>& nodes, const RunOptions& options, PhaseClock& clock) {
+    if (nodes.empty()) return;
+    if (options.engine == Engine::BYTECODE) {
+      engines.chunk.Clear();
+      engines.compiler.Compile(nodes);
+      clock.Lap(&PhaseTimes::compile);
+      RunChunk(engines.chunk, nodes, options);
+    } else if (options.engine == Engine::CLOSURE) {
+      engines.closures.Compile(nodes);
+      clock.Lap(&PhaseTimes::compile);
+      engines.closures.Run();
+    } else {
+      RunTree(nodes, options.stats);
+    }
+    clock.Lap(&PhaseTimes::execute);
+  }
+
+  void RunTree(const std::vector<NodeId>& nodes, RunStats* stats) {
+    if (!stats) {
+      for (NodeId node : nodes) ast.Run(node, table);
+      return;
+    }
+    ast.SetExecutionCounts(stats->executed.data());
+    for (NodeId node : nodes) ast.Run<true>(node, table);
+  }
+
+  // Run code compiled from 'nodes'; with stats, instructions are counted by the Type
+  // of the node they came from.
+  void RunChunk(const Chunk& chunk, const std::vector<NodeId>& nodes, const RunOptions& options) {
+    VM vm(chunk, ast, table, out);
+    if (!options.stats && !options.profile) {
+      vm.Run();
+      return;
+    }
+
+    std::vector<uint64_t> counts, ticks;
+    if (options.profile) {
+      vm.Run(counts, ticks);
+      options.profile->Add(chunk, ast, nodes, counts, ticks);
+    } else {
+      vm.Run(counts);
+    }
+    if (options.stats) {
+      for (size_t i = 0; i < counts.size(); ++i) {
+        if (chunk.origins[i] != NO_NODE) options.stats->executed[ast[chunk.origins[i]].type] += counts[i];
+      }
     }
   }
 
+  // Parse and execute one top-level statement at a time, releasing its tokens and
+  // nodes before moving on, so memory stays bounded by the largest statement
+  // rather than the whole script.  Output of earlier statements appears before a
+  // later parse error is reported.
+  void ParseStreaming(const RunOptions& options) {
+    PhaseClock clock(options.stats);
+    Engines engines(ast, table, out); // The compiler keeps its constant pool across statements
+    std::vector<int> temporaries;     // Slots each statement's optimizer temporaries share
+    std::vector<NodeId> nodes;
+    size_t parsed = 0;
+
+    while (tokens.Has(token_id)) {
+      nodes.assign(1, parseStatement());
+      CheckParsing(nodes[0], ++parsed);
+      clock.Lap(&PhaseTimes::parse);
+      RecordParsed(options.stats);
+      if (options.optimize) {
+        Optimizer(ast, table, &temporaries).Optimize(nodes, false);
+        clock.Lap(&PhaseTimes::optimize);
+      }
+
+      Execute(engines, nodes, options, clock);
+
+      ast.Clear();
+      tokens.Release(token_id);
+    }
+    if (options.stats) options.stats->symbol_bytes = table.Bytes();
+  }
+
   // Parses an identifier assignment statement (e.g., x = expr;)
-  ASTNode* parseIdentifier(bool singleLineStatement = false) {
-    std::string identifier = tokens[token_id].lexeme;
-    int unique_id = table.GetUniqueId(identifier);
+  NodeId parseIdentifier(bool singleLineStatement = false) {
+    const emplex::Token& token = tokens[token_id]; // Not always an identifier in a single-line loop
+    int unique_id = token == Lexer::ID_identifier ? table.GetUniqueId(tokens.SymbolAt(token_id))
+                                                  : table.GetUniqueId(token.lexeme);
+    uint32_t identifier_token = token_id;
 
     if (tokens[++token_id] != Lexer::ID_assignment) {
-      Utils::error("Expected = after identifier", tokens[token_id]);
+      Utils::error("Expected = after identifier", tokens[token_id], source);
     }
     ++token_id;
 
-    ASTNode* assignmentNode = new ASTNode(ASSIGNMENT);
-    ASTNode* variableNode = new ASTNode(VARIABLE, unique_id);
-    ASTNode* expressionNode = parseExpression();
-
-    assignmentNode->SetLeft(variableNode);
-    assignmentNode->SetRight(expressionNode);
+    NodeId expressionNode = parseExpression();
+    NodeId assignmentNode = ast.AddAssignment(unique_id, expressionNode, identifier_token);
 
     if (tokens[token_id] != Lexer::ID_semicolon && !singleLineStatement) {
-      Utils::error("Expected semicolon at end of expression", tokens[token_id]);
+      Utils::error("Expected semicolon at end of expression", tokens[token_id], source);
     }
     ++token_id;
     return assignmentNode;
   }
 
   // Parses a print statement (e.g., print(expr);)
-  ASTNode* parsePrint() {
+  NodeId parsePrint() {
+    uint32_t print_token = token_id;
     ++token_id;
     if (tokens[token_id] != Lexer::ID_open_parenthesis) {
-      Utils::error("Expected ( after print keyword", tokens[token_id]);
+      Utils::error("Expected ( after print keyword", tokens[token_id], source);
     }
     ++token_id;
 
 
-    ASTNode* expression;
+    NodeId expression;
     if (tokens[token_id].id == Lexer::ID_string) {
-      std::string str = tokens[token_id++].lexeme;
-      str = str.substr(1, str.length() - 2);
-      auto entries = getVariableEntriesInString(str);
-      expression = new ASTNode(STRING, str, entries);
+      uint32_t string_token = token_id;
+      std::string_view str = tokens[token_id++].lexeme;
+      expression = ast.AddString(splitInterpolatedString(str.substr(1, str.length() - 2)), string_token);
     }
     else 
       expression = parseLogical();
 
     if (tokens[token_id] != Lexer::ID_close_parenthesis) {
-      Utils::error("Expected closing parenthesis at the end of print expression", tokens[token_id]);
+      Utils::error("Expected closing parenthesis at the end of print expression", tokens[token_id], source);
     }
     ++token_id;
 
     if (tokens[token_id] != Lexer::ID_semicolon) {
-      Utils::error("Expected semicolon at end of print statement", tokens[token_id]);
+      Utils::error("Expected semicolon at end of print statement", tokens[token_id], source);
     }
     ++token_id;
 
-    ASTNode* printNode = new ASTNode(PRINT);
-    printNode->SetLeft(expression);
-    return printNode;
+    return ast.AddPrint(expression, print_token);
   }
 
-  std::vector<std::pair<int, int>> getVariableEntriesInString(std::string& str)
+  // Splits the body of a string literal into literal text and {variable} segments
+  std::vector<StringSegment> splitInterpolatedString(std::string_view str)
   {
-    size_t i = 0, index = 0;
-    std::vector<std::pair<int, int>> entries{};
+    std::vector<StringSegment> segments(1);
+    size_t i = 0;
+    size_t close = 0; // Next '}' after the current '{' (npos once there are none left)
     while (i < str.length()) {
-      if (str[i] == '{') {
-        size_t j = i + 1;
-        while (j < str.length() && str[j] != '}') ++j;
-        if (j < str.length() && str[j] == '}') {
-          std::string var_name = str.substr(i + 1, j - i - 1); // extract variable name inside {}
-          int unique_id = table.GetUniqueId(var_name); // get unique id
-          entries.push_back(std::make_pair(i, unique_id)); // append index of a variable in a string with its unique id
-          str.erase(i, j - i + 1); // erase {} from a string
-
-        }
-        else if (i >= str.length())
-          Utils::error("Expected } inside the string");
+      if (str[i] == '{' && close != std::string_view::npos && close <= i) close = str.find('}', i + 1);
+      if (str[i] != '{' || close == std::string_view::npos) {
+        segments.back().literal += str[i++];
+        continue;
       }
-      i++;
+
+      std::string var_name(str.substr(i + 1, close - i - 1)); // extract variable name inside {}
+      segments.back().slot = table.GetUniqueId(var_name);
+      segments.emplace_back();
+      i = close + 1;
+      // The character right after a '}' is always literal text, even another '{'
+      if (i < str.length()) segments.back().literal += str[i++];
     }
-    return entries;
+    return segments;
   }
 };
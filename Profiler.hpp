@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ASTNode.hpp"
+#include "Bytecode.hpp"
+
+// Cheap monotonic tick counter for per-instruction timing (the TSC on x86).
+inline uint64_t ProfileTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Maps positions in the source text to 1-based line numbers.
+class LineIndex {
+private:
+  std::string_view source;
+  std::vector<size_t> starts; // Offset of the first character of each line
+
+public:
+  LineIndex(std::string_view source) : source(source) {
+    starts.push_back(0);
+    for (size_t i = 0; i < source.size(); ++i) {
+      if (source[i] == '\n') starts.push_back(i + 1);
+    }
+  }
+
+  size_t Line(const char* pos) const {
+    size_t offset = static_cast<size_t>(pos - source.data());
+    return static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+  }
+
+  std::string_view Text(size_t line) const {
+    size_t begin = starts[line - 1];
+    size_t end = line < starts.size() ? starts[line] - 1 : source.size();
+    std::string_view text = source.substr(begin, end - begin);
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) text.remove_suffix(1);
+    return text;
+  }
+};
+
+// Execution counts and time of a script, by source line and by enclosing
+// while/if construct.  Fed with per-instruction counts and ticks from the VM.
+class Profile {
+private:
+  struct Cost {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+  };
+
+  LineIndex lines;
+  std::map<size_t, Cost> by_line;
+  std::map<std::pair<size_t, std::string>, Cost> by_construct; // (line, "while"/"if"), inclusive
+  std::map<std::string, uint64_t> folded;                       // "script;while (line 4);line 7" -> ticks
+  uint64_t total_ticks = 0;
+  uint64_t start_ticks;
+  std::chrono::steady_clock::time_point start_time;
+
+  size_t LineOf(const AST& ast, NodeId id) const { return lines.Line(ast.GetToken(id).lexeme.data()); }
+
+  static const char* ConstructName(const ASTNode& node) { return node.type == WHILE_LOOP ? "while" : "if"; }
+
+  // Record the innermost while/if around every node ('inside' for the node itself).
+  static void FindConstructs(const AST& ast, NodeId id, NodeId inside, std::vector<NodeId>& construct_of,
+                             std::vector<NodeId>& parent_of) {
+    if (id == NO_NODE) return;
+    const ASTNode& node = ast[id];
+    if (node.type == WHILE_LOOP || node.type == IF_STATEMENT) {
+      parent_of[id] = inside;
+      inside = id;
+    }
+    construct_of[id] = inside;
+
+    switch (node.type) {
+      case ASSIGNMENT:
+        FindConstructs(ast, node.assign.value, inside, construct_of, parent_of);
+        break;
+      case UNARY_OPERATION:
+      case BINARY_OPERATION:
+        FindConstructs(ast, node.binary.left, inside, construct_of, parent_of);
+        FindConstructs(ast, node.binary.right, inside, construct_of, parent_of);
+        break;
+      case PRINT:
+      case ELSE_STATEMENT:
+        FindConstructs(ast, node.child, inside, construct_of, parent_of);
+        break;
+      case STATEMENT_BLOCK:
+        for (const NodeId* it = ast.BlockBegin(id); it != ast.BlockEnd(id); ++it) {
+          FindConstructs(ast, *it, inside, construct_of, parent_of);
+        }
+        break;
+      case IF_STATEMENT:
+      case WHILE_LOOP:
+        FindConstructs(ast, node.branch.cond, inside, construct_of, parent_of);
+        FindConstructs(ast, node.branch.body, inside, construct_of, parent_of);
+        FindConstructs(ast, node.branch.else_body, inside, construct_of, parent_of);
+        break;
+      default:
+        break;
+    }
+  }
+
+  static double Percent(uint64_t part, uint64_t whole) { return whole ? 100.0 * part / whole : 0; }
+
+public:
+  Profile(std::string_view source)
+    : lines(source), start_ticks(ProfileTicks()), start_time(std::chrono::steady_clock::now()) {}
+
+  // Attribute one VM run of 'chunk' (compiled from 'roots') to lines and constructs.
+  void Add(const Chunk& chunk, const AST& ast, const std::vector<NodeId>& roots,
+           const std::vector<uint64_t>& counts, const std::vector<uint64_t>& ticks) {
+    std::vector<NodeId> construct_of(ast.size(), NO_NODE), parent_of(ast.size(), NO_NODE);
+    for (NodeId root : roots) FindConstructs(ast, root, NO_NODE, construct_of, parent_of);
+
+    for (size_t i = 0; i < counts.size(); ++i) {
+      NodeId origin = chunk.origins[i];
+      if (counts[i] == 0 || origin == NO_NODE) continue;
+      size_t line = LineOf(ast, origin);
+      Cost& cost = by_line[line];
+      cost.count += counts[i];
+      cost.ticks += ticks[i];
+      total_ticks += ticks[i];
+
+      // Enclosing constructs, innermost first
+      std::vector<NodeId> stack;
+      for (NodeId c = construct_of[origin]; c != NO_NODE; c = parent_of[c]) stack.push_back(c);
+
+      std::string frames = "script";
+      for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+        size_t construct_line = LineOf(ast, *it);
+        Cost& inclusive = by_construct[{construct_line, ConstructName(ast[*it])}];
+        inclusive.count += counts[i];
+        inclusive.ticks += ticks[i];
+        frames += ";" + std::string(ConstructName(ast[*it])) + " (line " + std::to_string(construct_line) + ")";
+      }
+      folded[frames + ";line " + std::to_string(line)] += ticks[i];
+    }
+  }
+
+  // Flat report: lines by time, then constructs by inclusive time.
+  void PrintReport(std::ostream& os) const {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    uint64_t elapsed_ticks = ProfileTicks() - start_ticks;
+    double ms_per_tick = elapsed_ticks ? elapsed * 1e3 / static_cast<double>(elapsed_ticks) : 0;
+
+    std::vector<std::pair<size_t, Cost>> rows(by_line.begin(), by_line.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second.ticks > b.second.ticks; });
+
+    os << std::fixed << std::setprecision(3);
+    os << "    line           count    time (ms)       %  source\n";
+    for (const auto& [line, cost] : rows) {
+      std::string_view text = lines.Text(line).substr(0, 60);
+      os << std::setw(8) << line << std::setw(16) << cost.count << std::setw(13) << cost.ticks * ms_per_tick
+         << std::setw(7) << std::setprecision(1) << Percent(cost.ticks, total_ticks) << "%  "
+         << std::setprecision(3) << text << "\n";
+    }
+
+    std::vector<std::pair<std::pair<size_t, std::string>, Cost>> constructs(by_construct.begin(), by_construct.end());
+    std::sort(constructs.begin(), constructs.end(),
+              [](const auto& a, const auto& b) { return a.second.ticks > b.second.ticks; });
+    if (!constructs.empty()) os << "construct                count    time (ms)       %  (inclusive)\n";
+    for (const auto& [key, cost] : constructs) {
+      std::string name = key.second + " (line " + std::to_string(key.first) + ")";
+      os << "  " << std::left << std::setw(22) << name << std::right << std::setw(16) << cost.count
+         << std::setw(13) << cost.ticks * ms_per_tick << std::setw(7) << std::setprecision(1)
+         << Percent(cost.ticks, total_ticks) << "%\n" << std::setprecision(3);
+    }
+    os << std::defaultfloat;
+  }
+
+  // One "frame;frame;... weight" line per stack, as flamegraph.pl and similar tools expect.
+  void PrintFolded(std::ostream& os) const {
+    for (const auto& [stack, ticks] : folded) {
+      if (ticks > 0) os << stack << " " << ticks << "\n";
+    }
+  }
+};
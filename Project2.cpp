@@ -1,45 +1,233 @@
 #include <assert.h>
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 // Below are some suggestions on how you might want to divide up your project.
 // You may delete this and divide it up however you like.
 #include "ASTNode.hpp"
+#include "Batch.hpp"
+#include "ImageCache.hpp"
 #include "lexer.hpp"
 #include "SymbolTable.hpp"
 #include "Parser.hpp"
+#include "Server.hpp"
+#include "SourceFile.hpp"
 
 int main(int argc, char * argv[])
 {
-  if (argc != 2) {
-    std::cout << "Format: " << argv[0] << " [filename]" << std::endl;
-    exit(1);
+  RunOptions options;
+  std::vector<std::string> filenames;
+  std::string manifest_filename;                // Batch: one script path per line
+  std::string status_filename;                  // Batch: exit status of each script
+  size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+  std::string serve_path;                       // Daemon: Unix socket to listen on ("-" for stdin)
+  std::string connect_path;                     // Client: run the scripts on this daemon
+  bool use_cache = false;                       // Reuse a program image from an earlier run
+  std::string cache_dir;                        // Where images go (default: next to the script)
+  std::string output_filename;
+  bool async_output = false;
+  bool report_timings = false;
+  bool report_stats = false;
+  std::string profile_filename;
+  RunStats stats;
+  bool bad_args = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--engine=tree") options.engine = Engine::TREE;
+    else if (arg == "--engine=vm") options.engine = Engine::BYTECODE;
+    else if (arg == "--engine=closure") options.engine = Engine::CLOSURE;
+    else if (arg == "--no-optimize") options.optimize = false;
+    else if (arg == "--no-jit") options.jit = false;
+    else if (arg == "--stream") options.streaming = true;
+    else if (arg == "--cache") use_cache = true;
+    else if (arg.rfind("--cache-dir=", 0) == 0 && arg.size() > 12) { use_cache = true; cache_dir = arg.substr(12); }
+    else if (arg == "--async-output") async_output = true;
+    else if (arg == "--timings") report_timings = true;
+    else if (arg == "--stats") report_stats = true;
+    else if (arg.rfind("--profile=", 0) == 0 && arg.size() > 10) profile_filename = arg.substr(10);
+    else if (arg.rfind("--output=", 0) == 0 && arg.size() > 9) output_filename = arg.substr(9);
+    else if (arg.rfind("--manifest=", 0) == 0 && arg.size() > 11) manifest_filename = arg.substr(11);
+    else if (arg.rfind("--status=", 0) == 0 && arg.size() > 9) status_filename = arg.substr(9);
+    else if (arg.rfind("--serve=", 0) == 0 && arg.size() > 8) serve_path = arg.substr(8);
+    else if (arg.rfind("--connect=", 0) == 0 && arg.size() > 10) connect_path = arg.substr(10);
+    else if (arg.rfind("--max-steps=", 0) == 0 && std::strtoull(arg.c_str() + 12, nullptr, 10) > 0) options.limits.steps = std::strtoull(arg.c_str() + 12, nullptr, 10);
+    else if (arg.rfind("--max-seconds=", 0) == 0 && std::atof(arg.c_str() + 14) > 0) options.limits.seconds = std::atof(arg.c_str() + 14);
+    else if (arg.rfind("--max-memory=", 0) == 0 && std::atof(arg.c_str() + 13) > 0) options.limits.memory = static_cast<size_t>(std::atof(arg.c_str() + 13) * 1048576);
+    else if (arg.rfind("--threads=", 0) == 0 && std::atoi(arg.c_str() + 10) > 0) options.threads = static_cast<unsigned>(std::atoi(arg.c_str() + 10));
+    else if (arg.rfind("--jobs=", 0) == 0 && std::atoi(arg.c_str() + 7) > 0) jobs = static_cast<size_t>(std::atoi(arg.c_str() + 7));
+    else if (arg[0] != '-' || arg == "-") filenames.push_back(arg);
+    else bad_args = true;
   }
 
+  if (!manifest_filename.empty()) {
+    std::ifstream manifest(manifest_filename);
+    if (!manifest) {
+      std::cout << "ERROR: Unable to open manifest '" << manifest_filename << "'." << std::endl;
+      exit(1);
+    }
+    for (std::string line; std::getline(manifest, line);) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) filenames.push_back(line);
+    }
+  }
+  bool batch = filenames.size() > 1 || !manifest_filename.empty();
+  bool serve = !serve_path.empty();
 
+  if (bad_args || filenames.empty() != serve || (!batch && !status_filename.empty()) || (serve && !connect_path.empty())) {
+    std::cout << "Format: " << argv[0] << " [--engine=tree|vm|closure] [--no-optimize] [--no-jit] [--stream] [--output=file] [--async-output] [--cache | --cache-dir=dir] [--max-steps=N] [--max-seconds=S] [--max-memory=MB] [--threads=N] [--timings] [--stats] [--profile=folded-file] [filename | -]" << std::endl;
+    std::cout << "        " << argv[0] << " [engine, limit and output options] [--jobs=N] [--status=file] [--manifest=file] [filename...]" << std::endl;
+    std::cout << "        " << argv[0] << " [engine and limit options] --serve=socket|-" << std::endl;
+    std::cout << "        " << argv[0] << " --connect=socket [--output=file] [filename...]" << std::endl;
+    exit(1);
+  }
+
+  if (serve) {                                  // Daemon: run scripts sent over the socket (or stdin)
+    if (options.streaming || report_timings || report_stats || !profile_filename.empty() ||
+        !output_filename.empty() || async_output || use_cache) {
+      std::cout << "ERROR: --serve takes engine and limit options only." << std::endl;
+      exit(1);
+    }
+    if (serve_path == "-") {
+      ServeStdin(options);
+      return 0;
+    }
+    ServeSocket(serve_path, options);
+    std::cout << "ERROR: Unable to listen on socket '" << serve_path << "'." << std::endl;
+    exit(1);
+  }
 
-  std::string filename = argv[1];
+  if (!connect_path.empty()) {                  // Client: the daemon's options apply
+    Output& output = Output::Standard();
+    if (!output_filename.empty() && !output.Open(output_filename)) {
+      std::cout << "ERROR: Unable to open output file '" << output_filename << "'." << std::endl;
+      exit(1);
+    }
+    int status = RunOnServer(connect_path, filenames, output);
+    output.Flush();
+    if (status < 0) {
+      std::cout << "ERROR: Unable to reach server at '" << connect_path << "'." << std::endl;
+      exit(1);
+    }
+    return status;
+  }
   
-  std::ifstream in_file(filename);              // Load the input file
-  if (in_file.fail()) {
+  if (batch) {                                  // Many scripts at once, each on its own
+    if (report_timings || report_stats || !profile_filename.empty() || use_cache) {
+      std::cout << "ERROR: --timings, --stats, --profile and --cache work with a single script only." << std::endl;
+      exit(1);
+    }
+    Output& output = Output::Standard();
+    if (!output_filename.empty() && !output.Open(output_filename)) {
+      std::cout << "ERROR: Unable to open output file '" << output_filename << "'." << std::endl;
+      exit(1);
+    }
+    if (async_output) output.StartWriter();
+
+    std::vector<int> statuses = RunBatch(filenames, options, jobs, output, std::cerr);
+    output.Flush();
+    if (!status_filename.empty()) {
+      std::ofstream status(status_filename);
+      for (size_t i = 0; i < filenames.size(); ++i) status << statuses[i] << '\t' << filenames[i] << '\n';
+      if (!status) {
+        std::cout << "ERROR: Unable to write status file '" << status_filename << "'." << std::endl;
+        exit(1);
+      }
+    }
+    return std::count(statuses.begin(), statuses.end(), 0) == static_cast<long>(statuses.size()) ? 0 : 1;
+  }
+
+  const std::string& filename = filenames[0];
+  SourceFile source;                            // Map the input file ("-" for stdin)
+  if (!source.Open(filename)) {
     std::cout << "ERROR: Unable to open file '" << filename << "'." << std::endl;
     exit(1);
   }
 
+  Output& output = Output::Standard();          // Buffered program output
+  if (!output_filename.empty() && !output.Open(output_filename)) {
+    std::cout << "ERROR: Unable to open output file '" << output_filename << "'." << std::endl;
+    exit(1);
+  }
+  if (async_output) output.StartWriter();
+
+  if (use_cache && options.streaming) {
+    std::cout << "ERROR: --cache needs the whole program; it does not work with --stream." << std::endl;
+    exit(1);
+  }
+  if (!profile_filename.empty() && options.engine != Engine::BYTECODE) {
+    std::cout << "ERROR: --profile works with the bytecode engine only." << std::endl;
+    exit(1);
+  }
+  Profile profile(source.Text());               // Per-line costs for --profile
+  std::ofstream folded;
+  if (!profile_filename.empty()) {
+    folded.open(profile_filename);
+    if (!folded) {
+      std::cout << "ERROR: Unable to open profile file '" << profile_filename << "'." << std::endl;
+      exit(1);
+    }
+    options.profile = &profile;
+  }
+
 
   // TO DO:  
   // PARSE input file to create Abstract Syntax Tree (AST).
   // EXECUTE the AST to run your program.
 
-  Parser parser(in_file);
+  if (report_timings || report_stats) options.stats = &stats;
+  if (report_stats) options.jit = false;        // Native code counts no executed nodes; --timings keeps it
+  PerfCounters counters;                        // Only opened for --stats
+  Parser parser(source.Text());
 
   
   //parser.print_tokens();
-  parser.Parse();
+  if (report_stats) {
+    counters.Open();
+    counters.Start();
+  }
+  try {
+    if (use_cache) {                            // Prepared program from an image, or parse and save one
+      ImageCache cache(cache_dir);
+      if (!cache.Load(parser, filename, source.Text(), options)) {
+        parser.Prepare(options);
+        cache.Store(parser, filename, source.Text(), options);
+      }
+      parser.RunPrepared(options);
+    } else {
+      parser.Parse(options);
+    }
+  } catch (const ScriptError& error) {
+    output.Flush();                             // Keep program output ahead of the message
+    std::cerr << error.what() << std::endl;
+    exit(ExitStatus(error));                    // 3 when a limit stopped it
+  }
+  if (report_stats) counters.Stop();
   //parser.print_table();
+
+  if (report_timings || report_stats) output.Flush();
+  if (report_timings) {                         // One JSON object on stderr, for bench/
+    const PhaseTimes& times = stats.wall;
+    std::cerr << "{\"image\": " << times.image << ", \"lex\": " << times.lex << ", \"parse\": " << times.parse
+              << ", \"optimize\": " << times.optimize << ", \"compile\": " << times.compile
+              << ", \"execute\": " << times.execute << "}" << std::endl;
+  }
+  if (options.profile) {
+    output.Flush();
+    profile.PrintReport(std::cerr);
+    profile.PrintFolded(folded);
+  }
+  if (report_stats) {
+    PrintStats(std::cerr, stats);
+    std::cerr << "hardware counters\n";
+    counters.Print(std::cerr);
+  }
   
   return 0;
 }
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+// Lock-free single-producer / single-consumer byte queue.  One thread pushes and
+// one thread pops.  Positions only ever grow and are reduced modulo the capacity
+// (a power of two) when indexing.
+class RingBuffer {
+private:
+  std::unique_ptr<char[]> data;
+  size_t capacity;
+  alignas(64) std::atomic<size_t> head{0}; // Next byte to pop; written by the consumer only
+  alignas(64) std::atomic<size_t> tail{0}; // Next byte to push; written by the producer only
+
+public:
+  explicit RingBuffer(size_t min_capacity) : capacity(std::bit_ceil(min_capacity)) {
+    data = std::make_unique<char[]>(capacity);
+  }
+
+  bool Empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+  // Producer: copy in as many of 'size' bytes as fit; returns how many did.
+  size_t Push(const char* bytes, size_t size) {
+    size_t end = tail.load(std::memory_order_relaxed);
+    size_t count = std::min(size, capacity - (end - head.load(std::memory_order_acquire)));
+    size_t offset = end & (capacity - 1);
+    size_t first = std::min(count, capacity - offset);
+    std::memcpy(data.get() + offset, bytes, first);
+    std::memcpy(data.get(), bytes + first, count - first);
+    tail.store(end + count, std::memory_order_release);
+    return count;
+  }
+
+  // Producer: block until the consumer pops something.
+  void WaitForPop() {
+    size_t seen = head.load(std::memory_order_acquire);
+    if (seen != tail.load(std::memory_order_relaxed)) head.wait(seen, std::memory_order_acquire);
+  }
+
+  // Consumer: the oldest contiguous run of unread bytes (empty if there are none).
+  std::string_view Front() const {
+    size_t begin = head.load(std::memory_order_relaxed);
+    size_t offset = begin & (capacity - 1);
+    size_t count = std::min(tail.load(std::memory_order_acquire) - begin, capacity - offset);
+    return {data.get() + offset, count};
+  }
+
+  // Consumer: release the first 'count' bytes of Front().
+  void Pop(size_t count) {
+    head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    head.notify_one();
+  }
+};
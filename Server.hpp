@@ -0,0 +1,312 @@
+#pragma once
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Batch.hpp"
+#include "Output.hpp"
+#include "Parser.hpp"
+#include "SourceFile.hpp"
+#include "Utils.hpp"
+
+// Daemon mode: a long-lived server that runs scripts sent to it, keeping each
+// program it has lexed, parsed and optimized so that running it again only
+// costs the execution itself.
+//
+// Requests and responses travel over a Unix domain socket (or stdin/stdout) as
+// a header line followed by a body of the length it gives:
+//
+//   request:  "source <length>\n" <script text>
+//             "path <length>\n" <script filename, read by the server>
+//   response: "<exit status> <output length> <error length>\n" <output> <error>
+//
+// A connection may carry any number of requests, answered in order.
+
+// A script parsed once and run on demand.  Every run starts from freshly zeroed
+// variables and collects its own output.  Runs share the AST (which writes to a
+// single Output), so runs of the same program take turns; different programs
+// run in parallel.
+class CachedProgram {
+private:
+  std::string source;
+  std::string captured;             // Output of the run in progress
+  Output out{captured};
+  std::unique_ptr<Parser> parser;
+  std::string error;                // Parse error, reported by every run
+  std::mutex running;
+
+public:
+  // Throws LimitError if parsing went past a limit: that says nothing lasting
+  // about the program, so it must not be kept as its parse error.
+  CachedProgram(std::string text, const RunOptions& options)
+    : source(std::move(text)), parser(std::make_unique<Parser>(std::string_view(source), out)) {
+    try {
+      parser->Prepare(options);
+    } catch (const LimitError&) {
+      throw;
+    } catch (const ScriptError& failure) {
+      error = failure.what();
+      parser.reset();
+    }
+  }
+
+  const std::string& Source() const { return source; }
+
+  ScriptResult Run(const RunOptions& options) {
+    ScriptResult result;
+    if (!parser) {
+      result.error = error;
+      result.status = 1;
+      return result;
+    }
+    std::lock_guard<std::mutex> hold(running);
+    try {
+      parser->RunPrepared(options);
+    } catch (const ScriptError& failure) {
+      result.error = failure.what();
+      result.status = ExitStatus(failure);
+    }
+    out.Flush();
+    result.output.swap(captured);
+    captured.clear();
+    return result;
+  }
+};
+
+// Programs by the hash of their source text.  A hash collision simply runs the
+// newcomer uncached.  When full, the cache starts over; programs still running
+// stay alive until their runs finish.
+class ProgramCache {
+private:
+  static constexpr size_t MAX_PROGRAMS = 1024;
+
+  RunOptions options;
+  std::mutex lock;
+  std::unordered_map<size_t, std::shared_ptr<CachedProgram>> programs;
+
+public:
+  explicit ProgramCache(const RunOptions& options) : options(options) {}
+
+  ScriptResult Run(std::string text) {
+    size_t key = std::hash<std::string_view>{}(text);
+    std::shared_ptr<CachedProgram> program;
+    {
+      std::lock_guard<std::mutex> hold(lock);
+      auto found = programs.find(key);
+      if (found != programs.end()) program = found->second;
+    }
+    try {
+      if (program && program->Source() != text) return CachedProgram(std::move(text), options).Run(options);
+      if (!program) {
+        program = std::make_shared<CachedProgram>(std::move(text), options); // Parsed outside the lock
+        std::lock_guard<std::mutex> hold(lock);
+        if (programs.size() >= MAX_PROGRAMS) programs.clear();
+        programs.emplace(key, program);
+      }
+    } catch (const LimitError& failure) { // Left uncached, so the next request parses it again
+      ScriptResult result;
+      result.error = failure.what();
+      result.status = ExitStatus(failure);
+      return result;
+    }
+    return program->Run(options);
+  }
+};
+
+// Both ends of a connection, with buffered reads.
+class Connection {
+private:
+  int in, out;
+  std::string buffer;
+  size_t start = 0; // First unread byte of 'buffer'
+
+  // Read more bytes into 'buffer'; false at end of input.
+  bool Fill() {
+    if (start == buffer.size()) {
+      buffer.clear();
+      start = 0;
+    }
+    char chunk[1 << 16];
+    while (true) {
+      ssize_t count = read(in, chunk, sizeof(chunk));
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) return false;
+      buffer.append(chunk, static_cast<size_t>(count));
+      return true;
+    }
+  }
+
+public:
+  Connection(int in, int out) : in(in), out(out) {}
+
+  // Next line without its '\n'; false at end of input.
+  bool ReadLine(std::string& line) {
+    size_t end;
+    while ((end = buffer.find('\n', start)) == std::string::npos) {
+      if (!Fill()) return false;
+    }
+    line.assign(buffer, start, end - start);
+    start = end + 1;
+    return true;
+  }
+
+  // Exactly 'size' bytes; false if the input ends first.
+  bool Read(size_t size, std::string& bytes) {
+    while (buffer.size() - start < size) {
+      if (!Fill()) return false;
+    }
+    bytes.assign(buffer, start, size);
+    start += size;
+    return true;
+  }
+
+  bool Write(std::string_view bytes) {
+    while (!bytes.empty()) {
+      ssize_t count = write(out, bytes.data(), bytes.size());
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) return false;
+      bytes.remove_prefix(static_cast<size_t>(count));
+    }
+    return true;
+  }
+
+  // Send a request header and body.
+  bool Send(std::string_view kind, std::string_view body) {
+    return Write(std::string(kind) + ' ' + std::to_string(body.size()) + '\n') && Write(body);
+  }
+
+  // Receive a response; false if the connection ends first.
+  bool Receive(ScriptResult& result) {
+    std::string header;
+    size_t output_size, error_size;
+    if (!ReadLine(header)) return false;
+    std::istringstream fields(header);
+    if (!(fields >> result.status >> output_size >> error_size)) return false;
+    return Read(output_size, result.output) && Read(error_size, result.error);
+  }
+};
+
+// Answer requests until the client hangs up or sends something malformed.
+inline void ServeConnection(Connection& connection, ProgramCache& cache) {
+  std::string header, body;
+  while (connection.ReadLine(header)) {
+    std::istringstream fields(header);
+    std::string kind;
+    size_t size;
+    if (!(fields >> kind >> size) || (kind != "source" && kind != "path")) return;
+    if (!connection.Read(size, body)) return;
+
+    ScriptResult result;
+    if (kind == "source") {
+      result = cache.Run(std::move(body));
+    } else {
+      SourceFile file;
+      if (body != "-" && file.Open(body)) { // Not the server's own stdin
+        result = cache.Run(std::string(file.Text()));
+      } else {
+        result.output = "ERROR: Unable to open file '" + body + "'.\n";
+        result.status = 1;
+      }
+    }
+    if (!result.error.empty()) result.error += '\n';
+
+    std::string response = std::to_string(result.status) + ' ' + std::to_string(result.output.size()) + ' ' +
+                           std::to_string(result.error.size()) + '\n';
+    response += result.output;
+    response += result.error;
+    if (!connection.Write(response)) return;
+  }
+}
+
+// Serve requests read from stdin, answering on stdout, until stdin ends.
+inline void ServeStdin(const RunOptions& options) {
+  ProgramCache cache(options);
+  Connection connection(STDIN_FILENO, STDOUT_FILENO);
+  ServeConnection(connection, cache);
+}
+
+// Listen on a Unix domain socket at 'path' (replacing any stale one), serving
+// each client on its own thread.  Returns only if the socket cannot be set up.
+inline bool ServeSocket(const std::string& path, const RunOptions& options) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) return false;
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) return false;
+  unlink(path.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 64) < 0) {
+    close(listener);
+    return false;
+  }
+  signal(SIGPIPE, SIG_IGN); // A client that hangs up early only ends its own connection
+
+  ProgramCache cache(options);
+  while (true) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      close(listener);
+      return false;
+    }
+    std::thread([client, &cache] {
+      Connection connection(client, client);
+      ServeConnection(connection, cache);
+      close(client);
+    }).detach();
+  }
+}
+
+// Client side: run each script on the server at 'path', printing what it printed
+// and its error message as if it had run here.  Returns the exit status of the
+// last script that failed (0 if none did), or -1 if the server cannot be reached.
+inline int RunOnServer(const std::string& path, const std::vector<std::string>& filenames, Output& out) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) return -1;
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) return -1;
+  if (connect(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    close(server);
+    return -1;
+  }
+
+  Connection connection(server, server);
+  int status = 0;
+  for (const std::string& filename : filenames) {
+    SourceFile file;
+    ScriptResult result;
+    if (!file.Open(filename)) {
+      result.output = "ERROR: Unable to open file '" + filename + "'.\n";
+      result.status = 1;
+    } else if (!connection.Send("source", file.Text()) || !connection.Receive(result)) {
+      close(server);
+      return -1;
+    }
+    out.Write(result.output);
+    if (!result.error.empty()) {
+      out.Flush(); // Keep program output ahead of the message
+      std::cerr << result.error << std::flush;
+    }
+    if (result.status != 0) status = result.status;
+  }
+  close(server);
+  return status;
+}
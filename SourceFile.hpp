@@ -0,0 +1,67 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+
+// Read-only source text of a script.  Regular files are memory-mapped so the
+// lexer works directly on the page cache; pipes and stdin ("-") are read into a
+// buffer instead.
+class SourceFile {
+private:
+  void* mapping = nullptr;
+  size_t mapped_size = 0;
+  std::string buffer;
+  std::string_view text;
+
+  bool ReadAll(int fd) {
+    char chunk[1 << 16];
+    while (true) {
+      ssize_t count = read(fd, chunk, sizeof(chunk));
+      if (count == 0) break;
+      if (count < 0) return false;
+      buffer.append(chunk, static_cast<size_t>(count));
+    }
+    text = buffer;
+    return true;
+  }
+
+public:
+  SourceFile() = default;
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  ~SourceFile() {
+    if (mapping != nullptr) munmap(mapping, mapped_size);
+  }
+
+  // Load a file ("-" for stdin); returns false if it cannot be read.
+  bool Open(const std::string& filename) {
+    if (filename == "-") return ReadAll(STDIN_FILENO);
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    bool ok = false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+      mapped_size = static_cast<size_t>(info.st_size);
+      void* region = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (region != MAP_FAILED) {
+        mapping = region;
+        madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+        text = std::string_view(static_cast<const char*>(mapping), mapped_size);
+        ok = true;
+      }
+    }
+    if (!ok) ok = ReadAll(fd); // Pipes, empty files, or mmap failure
+    close(fd);
+    return ok;
+  }
+
+  std::string_view Text() const { return text; }
+};
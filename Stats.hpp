@@ -0,0 +1,151 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+#include "ASTNode.hpp"
+
+// Seconds spent in each phase of a run.  When streaming, lexing happens on
+// demand and is counted as parsing.
+struct PhaseTimes {
+  double image = 0;    // Loading or storing a cached program image
+  double lex = 0;
+  double parse = 0;
+  double optimize = 0;
+  double compile = 0;
+  double execute = 0;
+};
+
+// What a run did and held, gathered when RunOptions::stats is set.
+struct RunStats {
+  PhaseTimes wall;
+  PhaseTimes cpu;                            // Process CPU time
+  size_t tokens = 0;
+  std::array<uint64_t, NUM_TYPES> parsed{};   // AST nodes built, by Type
+  std::array<uint64_t, NUM_TYPES> executed{}; // Tree: nodes run; VM: instructions run, by the Type they came from; closures: not counted
+  size_t token_bytes = 0;                     // Peak bytes of each structure
+  size_t ast_bytes = 0;
+  size_t symbol_bytes = 0;
+};
+
+// Charges the time since the previous lap to a phase; does nothing without a target.
+class PhaseClock {
+private:
+  RunStats* stats;
+  std::chrono::steady_clock::time_point last_wall;
+  double last_cpu = 0;
+
+  static double CpuNow() {
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+  }
+
+public:
+  PhaseClock(RunStats* stats) : stats(stats) {
+    if (!stats) return;
+    last_wall = std::chrono::steady_clock::now();
+    last_cpu = CpuNow();
+  }
+
+  void Lap(double PhaseTimes::* phase) {
+    if (!stats) return;
+    auto wall = std::chrono::steady_clock::now();
+    double cpu = CpuNow();
+    stats->wall.*phase += std::chrono::duration<double>(wall - last_wall).count();
+    stats->cpu.*phase += cpu - last_cpu;
+    last_wall = wall;
+    last_cpu = cpu;
+  }
+};
+
+// Hardware counters for this process (user space only), if the kernel allows it.
+class PerfCounters {
+private:
+  static constexpr int COUNT = 3;
+  static constexpr const char* NAMES[COUNT] = {"cycles", "instructions", "branch misses"};
+  int fds[COUNT] = {-1, -1, -1};
+
+public:
+  PerfCounters() = default;
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters() {
+    for (int fd : fds) if (fd >= 0) close(fd);
+  }
+
+  // Open the counters (disabled); any the kernel refuses read as unavailable.
+  void Open() {
+    const uint64_t configs[COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < COUNT; ++i) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+  }
+
+  void Start() {
+    for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  void Stop() {
+    for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  void Print(std::ostream& os) const {
+    for (int i = 0; i < COUNT; ++i) {
+      uint64_t value = 0;
+      os << "  " << std::left << std::setw(16) << NAMES[i] << std::right;
+      if (fds[i] >= 0 && read(fds[i], &value, sizeof(value)) == sizeof(value)) os << std::setw(16) << value << "\n";
+      else os << std::setw(16) << "unavailable" << "\n";
+    }
+  }
+};
+
+// Human-readable report of a run.
+inline void PrintStats(std::ostream& os, const RunStats& stats) {
+  const std::pair<const char*, double PhaseTimes::*> phases[] = {
+    {"image", &PhaseTimes::image}, {"lex", &PhaseTimes::lex}, {"parse", &PhaseTimes::parse},
+    {"optimize", &PhaseTimes::optimize}, {"compile", &PhaseTimes::compile}, {"execute", &PhaseTimes::execute}};
+
+  os << std::fixed << std::setprecision(6);
+  os << "phase                 wall (s)         cpu (s)\n";
+  for (const auto& [name, phase] : phases) {
+    os << "  " << std::left << std::setw(16) << name << std::right
+       << std::setw(10) << stats.wall.*phase << std::setw(16) << stats.cpu.*phase << "\n";
+  }
+
+  os << "nodes                   parsed        executed\n";
+  for (size_t type = 0; type < NUM_TYPES; ++type) {
+    if (stats.parsed[type] == 0 && stats.executed[type] == 0) continue;
+    os << "  " << std::left << std::setw(16) << TypeName(static_cast<Type>(type)) << std::right
+       << std::setw(10) << stats.parsed[type] << std::setw(16) << stats.executed[type] << "\n";
+  }
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  os << "memory                   bytes\n"
+     << "  tokens          " << std::setw(10) << stats.token_bytes << "  (" << stats.tokens << " tokens)\n"
+     << "  ast             " << std::setw(10) << stats.ast_bytes << "\n"
+     << "  symbol table    " << std::setw(10) << stats.symbol_bytes << "\n"
+     << "  peak rss        " << std::setw(10) << static_cast<size_t>(usage.ru_maxrss) * 1024 << "\n";
+  os << std::defaultfloat;
+}
@@ -1,92 +1,131 @@
 #pragma once
 
 #include <assert.h>
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
+#include "Interner.hpp"
 #include "Utils.hpp"
 
-struct VarData {
-  double value;
-  int unique_id;
-
-  VarData(int unique_id) : unique_id(unique_id), value(0) {}
-  VarData(int unique_id, double value) : unique_id(unique_id), value(value) {}
-};
-
+// Variables by name while parsing, and their values while running.  Names are
+// interned; each symbol's innermost visible declaration sits directly in
+// 'bindings', and a declaration in an inner scope saves the one it shadows on a
+// stack that PopScope() unwinds, so lookups cost the same at any nesting depth.
 class SymbolTable {
 private:
-  std::vector<std::unordered_map<std::string, int>> scopes;
-  std::vector<VarData> variables;
+  // Innermost declaration of a symbol in the open scopes
+  struct Binding {
+    int unique_id = -1; // -1: not declared in any open scope
+    uint32_t depth = 0; // Scope it was declared in (0: global)
+  };
+
+  Interner names;
+  std::vector<Binding> bindings;                    // By symbol
+  std::vector<std::pair<Symbol, Binding>> shadowed; // What inner-scope declarations replaced
+  std::vector<size_t> scope_starts;                 // Size of 'shadowed' as each inner scope opened
+  std::vector<double> values; // Variable values, indexed directly by unique id
   int unique_id_increment = 0;
 
-  std::unordered_map<std::string, int>& GetCurrentScope() {
-    return scopes.back();
-  }
+  uint32_t Depth() const { return static_cast<uint32_t>(scope_starts.size()); }
 
 public:
-  SymbolTable() {
-    PushScope(); // Initialize with the global scope
-  }
+  SymbolTable() = default; // Starts in the global scope
 
-  bool HasVarInCurrentScope(const std::string& name) {
-    return GetCurrentScope().find(name) != GetCurrentScope().end();
+  // Interner the lexer fills with identifiers, so the parser can look them up by symbol
+  Interner& Names() { return names; }
+
+  bool HasVarInCurrentScope(Symbol symbol) const {
+    return HasVar(symbol) && bindings[symbol].depth == Depth();
   }
 
-  bool HasVar(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-      if (it->find(name) != it->end())
-        return true;
-    }
-    return false;
+  bool HasVarInCurrentScope(std::string_view name) const { return HasVarInCurrentScope(names.Find(name)); }
+
+  bool HasVar(Symbol symbol) const {
+    return symbol < bindings.size() && bindings[symbol].unique_id >= 0;
   }
 
+  bool HasVar(std::string_view name) const { return HasVar(names.Find(name)); }
+
   double GetValue(int unique_id) const {
-    for (const auto& varData : variables) {
-      if (varData.unique_id == unique_id)
-        return varData.value;
-    }
-    return -99999; // Error case
+    assert(unique_id >= 0 && unique_id < static_cast<int>(values.size()));
+    return values[unique_id];
   }
 
-  int GetUniqueId(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-      auto found = it->find(name);
-      if (found != it->end())
-        return found->second;
-    }
-    Utils::error("Variable not defined: " + name);
-    return -1;
+  // Direct access to the value slot of a variable (unique ids are dense indices)
+  double& Slot(int unique_id) {
+    assert(unique_id >= 0 && unique_id < static_cast<int>(values.size()));
+    return values[unique_id];
   }
 
-  int InitializeVar(const std::string& name) {
-    if (HasVarInCurrentScope(name)) {
-      Utils::error("Variable already defined in this scope: " + name);
+  size_t NumVars() const { return values.size(); }
+
+  // Base of the value array; only stable until the next InitializeVar/AddSlot.
+  double* Data() { return values.data(); }
+
+  // Reserve an anonymous slot (constants and temporaries for compiled code)
+  int AddSlot(double value = 0) {
+    values.push_back(value);
+    return unique_id_increment++;
+  }
+
+  // Copy of every value slot, for RestoreValues()
+  std::vector<double> SaveValues() const { return values; }
+
+  // Put back the slots saved by SaveValues(), dropping any added since
+  void RestoreValues(const std::vector<double>& saved) {
+    values = saved;
+    unique_id_increment = static_cast<int>(saved.size());
+  }
+
+  // Approximate bytes held: value slots, bindings and interned names
+  size_t Bytes() const {
+    return values.capacity() * sizeof(double) + bindings.capacity() * sizeof(Binding) +
+           shadowed.capacity() * sizeof(shadowed[0]) + scope_starts.capacity() * sizeof(size_t) + names.Bytes();
+  }
+
+  int GetUniqueId(Symbol symbol) const {
+    if (!HasVar(symbol)) Utils::error("Variable not defined: " + names.Name(symbol));
+    return bindings[symbol].unique_id;
+  }
+
+  int GetUniqueId(std::string_view name) const {
+    Symbol symbol = names.Find(name);
+    if (symbol == Interner::NONE) Utils::error("Variable not defined: " + std::string(name));
+    return GetUniqueId(symbol);
+  }
+
+  int InitializeVar(Symbol symbol) {
+    if (HasVarInCurrentScope(symbol)) {
+      Utils::error("Variable already defined in this scope: " + names.Name(symbol));
     }
 
-    GetCurrentScope()[name] = unique_id_increment;
-    variables.emplace_back(unique_id_increment, 0); // New variable with default value 0
+    if (symbol >= bindings.size()) bindings.resize(symbol + 1);
+    if (Depth() > 0) shadowed.emplace_back(symbol, bindings[symbol]); // Globals are never popped
+    bindings[symbol] = {unique_id_increment, Depth()};
+    values.push_back(0); // New variable with default value 0
     return unique_id_increment++;
   }
 
+  int InitializeVar(std::string_view name) { return InitializeVar(names.Intern(name)); }
+
   void UpdateVar(int unique_id, double value) {
-    for (auto& var : variables) {
-      if (var.unique_id == unique_id) {
-        var.value = value;
-        return;
-      }
-    }
+    Slot(unique_id) = value;
   }
 
   void PushScope() {
-    scopes.emplace_back();
+    scope_starts.push_back(shadowed.size());
   }
 
   void PopScope() {
-    if (scopes.size() > 1) {
-      scopes.pop_back();
-    } else {
+    if (scope_starts.empty()) {
       Utils::error("No scope to pop");
     }
+    for (size_t i = shadowed.size(); i > scope_starts.back(); --i) {
+      bindings[shadowed[i - 1].first] = shadowed[i - 1].second; // Undo newest first
+    }
+    shadowed.resize(scope_starts.back());
+    scope_starts.pop_back();
   }
 };
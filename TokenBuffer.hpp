@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "FastLexer.hpp"
+#include "Interner.hpp"
+#include "lexer.hpp"
+
+// Tokens of a source text, lexed on demand.  Tokens keep their absolute index
+// in the source; once released, earlier tokens are dropped, so a streaming
+// parser only holds the statement it is working on.  Given an Interner,
+// identifiers are interned as they are lexed.
+class TokenBuffer {
+private:
+  FastLexer lexer;
+  std::string_view source;
+  std::vector<emplex::Token> window; // Tokens [base, base + window.size())
+  Interner* names;
+  std::vector<Symbol> symbols;       // Symbol of each identifier in the window (NONE for other tokens)
+  size_t base = 0;
+  bool done = false;                 // The lexer has reached the end of the source
+  emplex::Token eof;                 // Returned for any index past the last token
+
+  // Lex the next non-ignored token into the window; false at end of input.
+  bool LexNext() {
+    while (!done) {
+      emplex::Token token = lexer.NextToken(source);
+      if (token.id == emplex::Lexer::ID__EOF_) done = true;
+      else if (!emplex::Lexer::IgnoreToken(token.id)) {
+        window.push_back(token);
+        if (names) symbols.push_back(SymbolOf(token));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Symbol SymbolOf(const emplex::Token& token) {
+    return token.id == emplex::Lexer::ID_identifier ? names->Intern(token.lexeme) : Interner::NONE;
+  }
+
+public:
+  TokenBuffer(std::string_view source, Interner* names = nullptr)
+    : source(source), names(names), eof{emplex::Lexer::ID__EOF_, source.substr(source.size())} {}
+
+  // Lex the whole source up front.
+  void LexAll() {
+    if (base == 0 && window.empty() && !done) {
+      window = lexer.Tokenize(source);
+      done = true;
+      if (names) {
+        symbols.reserve(window.size());
+        for (const emplex::Token& token : window) symbols.push_back(SymbolOf(token));
+      }
+    }
+    while (LexNext()) { }
+  }
+
+  // Is there a token at 'index'?  Lexes ahead as needed.
+  bool Has(size_t index) {
+    while (index >= base + window.size()) {
+      if (!LexNext()) return false;
+    }
+    return true;
+  }
+
+  // Token at 'index' (lexing ahead as needed), or EOF past the end of the input.
+  const emplex::Token& operator[](size_t index) {
+    return Has(index) ? window[index - base] : eof;
+  }
+
+  // Token at an index that has already been lexed and not released.
+  const emplex::Token& At(size_t index) const {
+    return index - base < window.size() ? window[index - base] : eof;
+  }
+
+  // Symbol of the identifier at an index that has already been lexed and not
+  // released (NONE if it is some other token); needs an Interner.
+  Symbol SymbolAt(size_t index) const { return symbols[index - base]; }
+
+  // Number of tokens lexed so far, including released ones.
+  size_t size() const { return base + window.size(); }
+
+  // Bytes currently allocated for tokens
+  size_t Bytes() const { return window.capacity() * sizeof(emplex::Token) + symbols.capacity() * sizeof(Symbol); }
+
+  // Drop every token before 'index'.
+  void Release(size_t index) {
+    if (index > size()) index = size();
+    window.erase(window.begin(), window.begin() + static_cast<std::ptrdiff_t>(index - base));
+    if (names) symbols.erase(symbols.begin(), symbols.begin() + static_cast<std::ptrdiff_t>(index - base));
+    base = index;
+  }
+};
@@ -1,19 +1,51 @@
 #pragma once
-#include <iostream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include "lexer.hpp"
+// A parse or runtime error that stops a script.  what() is the whole message;
+// whoever runs the script flushes its output, reports the message and fails
+// that script alone.
+class ScriptError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+// A script stopped for going past one of its resource limits (see Governor.hpp)
+class LimitError : public ScriptError
+{
+public:
+    using ScriptError::ScriptError;
+};
+// Exit status of a script that stopped with 'error': 3 for a resource limit, so
+// callers can tell a runaway script from a broken one, and 1 otherwise
+inline int ExitStatus(const ScriptError& error)
+{
+    return dynamic_cast<const LimitError*>(&error) ? 3 : 1;
+}
 class Utils
 {
+    static std::string At(const std::string& message, const emplex::Token& token, std::string_view source)
+    {
+        size_t line_id = emplex::Lexer::LineOf(source, token);
+        return "Error at line " + std::to_string(line_id) + ": " + message + ", lexeme: " +
+               std::string(token.lexeme) + " (id " + std::to_string(token.id) + ")";
+    }
 public:
-    static void error(std::string message, emplex::Token token)
+    [[noreturn]] static void error(std::string message, const emplex::Token& token, std::string_view source)
+    {
+        throw ScriptError(At(message, token, source));
+    }
+    [[noreturn]] static void limit_error(std::string message, const emplex::Token& token, std::string_view source)
+    {
+        throw LimitError(At(message, token, source));
+    }
+    [[noreturn]] static void limit_error(std::string message)
     {
-    
-        std::cerr << "Error at line " << token.line_id << ": " << message << ", lexeme: " << token.lexeme << " (id " << token.id << ")" << std::endl;
-        exit(1);
+        throw LimitError("Error: " + message);
     }
-    static void error(std::string message)
+    [[noreturn]] static void error(std::string message)
     {
-        std::cerr << "Error: " << message << std::endl;
-        exit(1);
+        throw ScriptError("Error: " + message);
     }
 };
\ No newline at end of file
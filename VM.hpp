@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "Bytecode.hpp"
+#include "Output.hpp"
+#include "Profiler.hpp"
+#include "SymbolTable.hpp"
+#include "Utils.hpp"
+
+// Dispatch-loop interpreter for compiled bytecode.
+class VM {
+private:
+  const Chunk& chunk;
+  const AST& ast;
+  SymbolTable& symbols;
+  Output& out;
+
+public:
+  VM(const Chunk& chunk, const AST& ast, SymbolTable& symbols, Output& out)
+    : chunk(chunk), ast(ast), symbols(symbols), out(out) {}
+
+  void Run() { Execute<false, false>(nullptr, nullptr); }
+
+  // Run, adding how often each instruction executed to 'counts' (one per instruction)
+  void Run(std::vector<uint64_t>& counts) {
+    counts.resize(chunk.code.size());
+    Execute<true, false>(counts.data(), nullptr);
+  }
+
+  // As above, also adding the ProfileTicks() spent in each instruction to 'ticks'
+  void Run(std::vector<uint64_t>& counts, std::vector<uint64_t>& ticks) {
+    counts.resize(chunk.code.size());
+    ticks.resize(chunk.code.size());
+    Execute<true, true>(counts.data(), ticks.data());
+  }
+
+private:
+  template <bool COUNT, bool TIME>
+  void Execute(uint64_t* counts, uint64_t* ticks) {
+    double* slots = symbols.Data();
+    const Instruction* code = chunk.code.data();
+    const Instruction* ip = code;
+    uint64_t last_tick = 0;
+    size_t last_index = 0;
+    if constexpr (TIME) last_tick = ProfileTicks();
+
+    while (true) {
+      if constexpr (COUNT) ++counts[ip - code];
+      if constexpr (TIME) {
+        uint64_t now = ProfileTicks();
+        ticks[last_index] += now - last_tick;
+        last_tick = now;
+        last_index = static_cast<size_t>(ip - code);
+      }
+      const Instruction& inst = *ip++;
+      switch (inst.op) {
+        case OpCode::MOVE: slots[inst.a] = slots[inst.b]; break;
+        case OpCode::ADD: slots[inst.a] = Sum(slots[inst.b], slots[inst.c]); break;
+        case OpCode::SUB: slots[inst.a] = slots[inst.b] - slots[inst.c]; break;
+        case OpCode::MUL: slots[inst.a] = Product(slots[inst.b], slots[inst.c]); break;
+        case OpCode::DIV:
+          if (slots[inst.c] == 0) ast.Error("Division by zero", chunk.origins[ip - code - 1]);
+          slots[inst.a] = slots[inst.b] / slots[inst.c];
+          break;
+        case OpCode::MOD: {
+          double rvalue = round(slots[inst.c]);
+          if (rvalue == 0) ast.Error("Modulus by zero", chunk.origins[ip - code - 1]);
+          slots[inst.a] = IntegerModulus(round(slots[inst.b]), rvalue);
+          break;
+        }
+        case OpCode::MOD_INT:
+          if (slots[inst.c] == 0) ast.Error("Modulus by zero", chunk.origins[ip - code - 1]);
+          slots[inst.a] = IntegerModulus(slots[inst.b], slots[inst.c]);
+          break;
+        case OpCode::POW: slots[inst.a] = pow(slots[inst.b], slots[inst.c]); break;
+        case OpCode::POW_INT: slots[inst.a] = IntegerPower(slots[inst.b], slots[inst.c]); break;
+        case OpCode::EQ: slots[inst.a] = slots[inst.b] == slots[inst.c] ? 1 : 0; break;
+        case OpCode::NE: slots[inst.a] = slots[inst.b] != slots[inst.c] ? 1 : 0; break;
+        case OpCode::GT: slots[inst.a] = slots[inst.b] > slots[inst.c] ? 1 : 0; break;
+        case OpCode::GE: slots[inst.a] = slots[inst.b] >= slots[inst.c] ? 1 : 0; break;
+        case OpCode::LT: slots[inst.a] = slots[inst.b] < slots[inst.c] ? 1 : 0; break;
+        case OpCode::LE: slots[inst.a] = slots[inst.b] <= slots[inst.c] ? 1 : 0; break;
+        case OpCode::NEG: slots[inst.a] = -slots[inst.b]; break;
+        case OpCode::NOT: slots[inst.a] = slots[inst.b] == 0 ? 1 : 0; break;
+        case OpCode::TRUTH: slots[inst.a] = slots[inst.b] != 0 ? 1 : 0; break;
+
+        case OpCode::JUMP: ip = code + inst.a; break;
+        case OpCode::JUMP_IF_TRUE: if (slots[inst.b] != 0) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_FALSE: if (slots[inst.b] == 0) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_EQ: if (slots[inst.b] == slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_NE: if (slots[inst.b] != slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_GT: if (slots[inst.b] > slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_GE: if (slots[inst.b] >= slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_LT: if (slots[inst.b] < slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_IF_LE: if (slots[inst.b] <= slots[inst.c]) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_EQ: if (!(slots[inst.b] == slots[inst.c])) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_NE: if (!(slots[inst.b] != slots[inst.c])) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_GT: if (!(slots[inst.b] > slots[inst.c])) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_GE: if (!(slots[inst.b] >= slots[inst.c])) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_LT: if (!(slots[inst.b] < slots[inst.c])) ip = code + inst.a; break;
+        case OpCode::JUMP_UNLESS_LE: if (!(slots[inst.b] <= slots[inst.c])) ip = code + inst.a; break;
+
+        case OpCode::STEP: ast.Step(chunk.origins[ip - code - 1]); break;
+
+        case OpCode::PRINT_NUM:
+          out.WriteNumber(slots[inst.a]);
+          out.Put('\n');
+          break;
+
+        case OpCode::PRINT_STRING:
+          for (const StringSegment& segment : chunk.strings[inst.a]) {
+            out.Write(segment.literal);
+            if (segment.slot >= 0) out.WriteNumber(slots[segment.slot]);
+          }
+          out.Put('\n');
+          break;
+
+        case OpCode::HALT:
+          return;
+      }
+    }
+  }
+};
@@ -0,0 +1,247 @@
+// Component microbenchmarks: DFA transitions, Lexer::NextToken (generated and
+// FastLexer), SymbolTable
+// operations and AST::Run per node type, each measured in isolation so that an
+// end-to-end regression (bench/run_bench.py) can be pinned on one component.
+//
+// Build and run with "make microbench"; an argument restricts the run to the
+// benchmarks whose name contains it (e.g. "bench/microbench symbols").
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "FastLexer.hpp"
+#include "Output.hpp"
+#include "SymbolTable.hpp"
+#include "TokenBuffer.hpp"
+#include "lexer.hpp"
+
+using emplex::DFA;
+using emplex::Lexer;
+
+// Keep the compiler from discarding a computed value.
+template <typename T>
+inline void Keep(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+static std::string filter;
+
+// Run 'body' (which performs 'ops' operations) a few times and report the best.
+static void Measure(const std::string& name, size_t ops, const std::function<void()>& body) {
+  if (!filter.empty() && name.find(filter) == std::string::npos) return;
+  double best = 1e30;
+  for (int round = 0; round < 5; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  double ns = best * 1e9 / static_cast<double>(ops);
+  std::printf("%-40s %10.2f ns/op %12.2f Mops/s\n", name.c_str(), ns, 1e3 / ns);
+}
+
+// As Measure(), for a body that processes 'bytes' bytes; reports GB/s.
+static void MeasureBytes(const std::string& name, size_t bytes, const std::function<void()>& body) {
+  if (!filter.empty() && name.find(filter) == std::string::npos) return;
+  double best = 1e30;
+  for (int round = 0; round < 5; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  std::printf("%-40s %10.3f GB/s\n", name.c_str(), static_cast<double>(bytes) / best * 1e-9);
+}
+
+// Representative script text: arithmetic, control flow and interpolated prints.
+static std::string MakeSource(size_t min_bytes) {
+  const std::string unit =
+    "// Step count for the Collatz Conjecture\n"
+    "var n = 27;\n"
+    "var count = 0;\n"
+    "while (n != 1) {\n"
+    "  if (n % 2 == 0) { n = n / 2; } else { n = 3 * n + 1; }\n"
+    "  count = count + 1;\n"
+    "  print(\"Step {count}: {n}\");\n"
+    "}\n"
+    "var ratio = (count * 2.5 - 1) ** 2 / 7.125;\n"
+    "if (ratio >= 10 && !(count == 3) || ratio < 0.5) print(ratio);\n";
+  std::string text;
+  while (text.size() < min_bytes) text += unit;
+  return text;
+}
+
+static void BenchDFA(const std::string& text) {
+  Measure("dfa/GetNext per char", text.size(), [&] {
+    int state = 0;
+    for (char c : text) {
+      state = DFA::GetNext(state, c);
+      if (state < 0) state = 0;
+    }
+    Keep(state);
+  });
+
+  Measure("dfa/GetStop per state", 1000000, [] {
+    int total = 0;
+    for (int i = 0; i < 1000000; ++i) total += DFA::GetStop(i % static_cast<int>(DFA::size()));
+    Keep(total);
+  });
+}
+
+// Does FastLexer produce exactly the tokens of the generated lexer?
+template <typename LEXER>
+static std::vector<emplex::Token> AllTokens(const std::string& text) {
+  LEXER lexer;
+  std::vector<emplex::Token> tokens;
+  do tokens.push_back(lexer.NextToken(text)); while (tokens.back().id);
+  return tokens;
+}
+
+static bool SameTokens(const std::string& text) {
+  std::vector<emplex::Token> expected = AllTokens<Lexer>(text);
+  std::vector<emplex::Token> actual = AllTokens<FastLexer>(text);
+  return std::equal(expected.begin(), expected.end(), actual.begin(), actual.end(),
+                    [](const emplex::Token& a, const emplex::Token& b) {
+                      return a.id == b.id && a.lexeme.data() == b.lexeme.data() && a.lexeme.size() == b.lexeme.size();
+                    });
+}
+
+template <typename LEXER>
+static void BenchLexer(const std::string& prefix, const std::string& text) {
+  auto lex = [&] {
+    LEXER lexer;
+    size_t seen = 0;
+    while (emplex::Token token = lexer.NextToken(text)) seen += token.lexeme.size();
+    Keep(seen);
+  };
+  Measure(prefix + "/NextToken per token", Lexer().Tokenize(text).size(), lex);
+  MeasureBytes(prefix + "/NextToken throughput", text.size(), lex);
+}
+
+static void BenchLexers(const std::string& text) {
+  // Whitespace, comment and string heavy text, where FastLexer skips runs in bulk
+  std::string sparse;
+  while (sparse.size() < text.size()) {
+    sparse += "    // ---------------------------------------------------------------\n"
+              "    print(\"a fairly long string literal, {n} times over\");\n\n";
+  }
+  if (!SameTokens(text) || !SameTokens(sparse)) {
+    std::printf("FastLexer and Lexer disagree on the benchmark text\n");
+    std::exit(1);
+  }
+  BenchLexer<Lexer>("lexer", text);
+  BenchLexer<FastLexer>("fastlexer", text);
+  BenchLexer<Lexer>("lexer sparse", sparse);
+  BenchLexer<FastLexer>("fastlexer sparse", sparse);
+}
+
+static void BenchSymbols() {
+  for (size_t depth : {1, 8, 64}) {
+    for (size_t vars : {10, 1000, 100000}) {
+      std::vector<std::string> names;
+      for (size_t i = 0; i < vars; ++i) names.push_back("var_" + std::to_string(i));
+      std::string suffix = " d=" + std::to_string(depth) + " n=" + std::to_string(vars);
+
+      Measure("symbols/InitializeVar" + suffix, vars, [&] {
+        SymbolTable table;
+        for (size_t i = 0; i < vars; ++i) {
+          if (i % (vars / depth + 1) == 0 && i > 0) table.PushScope();
+          table.InitializeVar(names[i]);
+        }
+        Keep(table);
+      });
+
+      // Variables spread over 'depth' scopes; lookups start from the innermost.
+      SymbolTable table;
+      for (size_t i = 0; i < vars; ++i) {
+        if (i % (vars / depth + 1) == 0 && i > 0) table.PushScope();
+        table.InitializeVar(names[i]);
+      }
+      size_t lookups = 50000;
+      Measure("symbols/GetUniqueId" + suffix, lookups, [&] {
+        int total = 0;
+        for (size_t i = 0; i < lookups; ++i) total += table.GetUniqueId(names[(i * 7919) % vars]);
+        Keep(total);
+      });
+      std::vector<Symbol> symbols; // As the parser sees identifiers, interned by the lexer
+      for (const std::string& name : names) symbols.push_back(table.Names().Intern(name));
+      Measure("symbols/GetUniqueId(symbol)" + suffix, lookups, [&] {
+        int total = 0;
+        for (size_t i = 0; i < lookups; ++i) total += table.GetUniqueId(symbols[(i * 7919) % vars]);
+        Keep(total);
+      });
+      Measure("symbols/GetValue" + suffix, lookups, [&] {
+        double total = 0;
+        for (size_t i = 0; i < lookups; ++i) total += table.GetValue(static_cast<int>((i * 7919) % vars));
+        Keep(total);
+      });
+      Measure("symbols/UpdateVar" + suffix, lookups, [&] {
+        for (size_t i = 0; i < lookups; ++i) table.UpdateVar(static_cast<int>((i * 7919) % vars), static_cast<double>(i));
+        Keep(table);
+      });
+    }
+  }
+}
+
+static void BenchNodes() {
+  // Operator tokens the nodes refer to, at indices 0..14
+  const std::string operators = "+ - * / % ** == != > >= < <= && || !";
+  TokenBuffer tokens(operators);
+  tokens.LexAll();
+  int devnull = open("/dev/null", O_WRONLY);
+  Output out(devnull);
+  AST ast(tokens, operators, out);
+  SymbolTable symbols;
+  int a = symbols.InitializeVar("a");
+  int b = symbols.InitializeVar("b");
+  symbols.UpdateVar(a, 7.5);
+  symbols.UpdateVar(b, 2.25);
+
+  const size_t runs = 2000000;
+  auto bench = [&](const std::string& name, NodeId node) {
+    Measure("node/" + name, runs, [&] {
+      double total = 0;
+      for (size_t i = 0; i < runs; ++i) total += ast.Run(node, symbols);
+      Keep(total);
+    });
+  };
+
+  bench("NUMBER", ast.AddNumber(3, 0));
+  bench("VARIABLE", ast.AddVariable(a, 0));
+  bench("ASSIGNMENT", ast.AddAssignment(b, ast.AddNumber(2.25, 0), 0));
+  bench("UNARY_OPERATION -", ast.AddUnary(ast.AddVariable(a, 0), 1));
+  bench("UNARY_OPERATION !", ast.AddUnary(ast.AddVariable(a, 0), 14));
+  const char* names[] = {"+", "-", "*", "/", "%", "**", "==", "!=", ">", ">=", "<", "<=", "&&", "||"};
+  for (uint32_t token = 0; token < 14; ++token) {
+    bench(std::string("BINARY_OPERATION ") + names[token],
+          ast.AddBinary(ast.AddVariable(a, 0), ast.AddVariable(b, 0), token));
+  }
+
+  bench("PRINT number", ast.AddPrint(ast.AddVariable(a, 0), 0));
+  bench("PRINT string", ast.AddPrint(ast.AddString({{"a is ", a}, {" and b is ", b}, {"", -1}}, 0), 0));
+
+  std::vector<NodeId> statements(8, ast.AddAssignment(b, ast.AddVariable(a, 0), 0));
+  bench("STATEMENT_BLOCK of 8", ast.AddBlock(statements, 0));
+  NodeId body = ast.AddAssignment(b, ast.AddNumber(1, 0), 0);
+  bench("IF_STATEMENT", ast.AddIf(ast.AddBinary(ast.AddVariable(a, 0), ast.AddVariable(b, 0), 8), body, NO_NODE, 0));
+  bench("WHILE_LOOP not taken", ast.AddWhile(ast.AddBinary(ast.AddVariable(a, 0), ast.AddVariable(b, 0), 10), body, 0));
+
+  out.Flush();
+  close(devnull);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) filter = argv[1];
+  std::string text = MakeSource(1 << 20);
+  BenchDFA(text);
+  BenchLexers(text);
+  BenchSymbols();
+  BenchNodes();
+  return 0;
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""End-to-end benchmark suite.
+
+Generates the workloads in bench/workloads.py, runs each one with --timings,
+and reports wall time, per-phase times, lexing throughput, peak RSS and the
+cold and warm start times with the program image cache (--cache-dir) as JSON.  Results are
+compared against a stored baseline; the exit status is 1 if any workload got
+slower (or bigger) than the baseline by more than the threshold.
+
+Usage: bench/run_bench.py [--exe ./Project2] [--repeat 3] [--scale 1.0]
+                          [--baseline bench/baseline.json] [--threshold 0.15]
+                          [--update-baseline] [--output results.json] [names...]
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import workloads
+
+PHASES = ["image", "lex", "parse", "optimize", "compile", "execute"]
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "baseline.json")
+
+
+def run_once(exe, path, options=()):
+    """Run one script; returns wall seconds, phase times and peak RSS in KiB."""
+    start = time.perf_counter()
+    proc = subprocess.Popen([exe, "--timings", *options, path], stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE)
+    stderr = proc.stderr.read()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        sys.exit(f"{path} failed:\n{stderr.decode(errors='replace')}")
+    phases = json.loads(stderr.decode().strip().splitlines()[-1])
+    return wall, phases, usage.ru_maxrss
+
+
+def measure(exe, path, repeat):
+    """Best-of-'repeat' wall time (with that run's phases) and the largest RSS."""
+    best = None
+    peak_rss = 0
+    for _ in range(repeat):
+        wall, phases, rss = run_once(exe, path)
+        peak_rss = max(peak_rss, rss)
+        if best is None or wall < best[0]:
+            best = (wall, phases)
+    result = {"wall": round(best[0], 6)}
+    result.update({phase: round(best[1][phase], 6) for phase in PHASES})
+    if best[1]["lex"] > 0:
+        result["lex_gbps"] = round(os.path.getsize(path) / best[1]["lex"] / 1e9, 4)
+    result["peak_rss_kb"] = peak_rss
+    return result
+
+
+def measure_cache(exe, path, repeat, cache_dir):
+    """Best-of-'repeat' wall times of a cold start (parse, then write the program
+    image) and of a warm start (load the image)."""
+    option = "--cache-dir=" + cache_dir
+    cold = warm = None
+    for _ in range(repeat):
+        shutil.rmtree(cache_dir, ignore_errors=True)
+        wall = run_once(exe, path, [option])[0]
+        cold = wall if cold is None else min(cold, wall)
+    for _ in range(repeat):
+        wall = run_once(exe, path, [option])[0]
+        warm = wall if warm is None else min(warm, wall)
+    return {"cold_wall": round(cold, 6), "warm_wall": round(warm, 6)}
+
+
+def compare(results, baseline, threshold):
+    """Ratios against the baseline, and the list of regressions."""
+    comparison = {}
+    regressions = []
+    for name, result in results.items():
+        base = baseline.get("workloads", {}).get(name)
+        if base is None:
+            continue
+        entry = {}
+        for metric in ("wall", "peak_rss_kb"):
+            if base.get(metric):
+                ratio = result[metric] / base[metric]
+                entry[metric] = round(ratio, 3)
+                if ratio > 1 + threshold:
+                    regressions.append(f"{name}: {metric} {ratio:.2f}x baseline")
+        comparison[name] = entry
+    return comparison, regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("names", nargs="*", help="workloads to run (default: all)")
+    parser.add_argument("--exe", default="./Project2")
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--scale", type=float, default=1.0)
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--threshold", type=float, default=0.15,
+                        help="allowed slowdown before a workload counts as regressed")
+    parser.add_argument("--update-baseline", action="store_true")
+    parser.add_argument("--output", help="write the JSON report here instead of stdout")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.exe):
+        sys.exit(f"Executable {args.exe} not found; run 'make' first.")
+    names = args.names or list(workloads.SUITE)
+    for name in names:
+        if name not in workloads.SUITE:
+            sys.exit(f"Unknown workload '{name}'; choose from {', '.join(workloads.SUITE)}")
+
+    results = {}
+    with tempfile.TemporaryDirectory() as tmp:
+        for name in names:
+            generate, params = workloads.SUITE[name]
+            params = workloads.scaled(params, args.scale)
+            path = os.path.join(tmp, f"{name}.Mc")
+            with open(path, "w") as f:
+                f.write(generate(**params))
+            results[name] = measure(args.exe, path, args.repeat)
+            results[name].update(measure_cache(args.exe, path, args.repeat, os.path.join(tmp, "cache")))
+            results[name]["params"] = params
+            print(f"{name:>14} {results[name]['wall']:>9.4f}s {results[name]['peak_rss_kb']:>8} KiB"
+                  f" lex {results[name].get('lex_gbps', 0):>7.3f} GB/s"
+                  f" cold {results[name]['cold_wall']:>8.4f}s warm {results[name]['warm_wall']:>8.4f}s",
+                  file=sys.stderr)
+
+    report = {"exe": args.exe, "repeat": args.repeat, "scale": args.scale, "workloads": results}
+    regressions = []
+    if args.update_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+        print(f"Baseline written to {args.baseline}", file=sys.stderr)
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("scale") != args.scale:
+            print("Baseline was recorded at a different --scale; not comparing.", file=sys.stderr)
+        else:
+            report["threshold"] = args.threshold
+            report["comparison"], regressions = compare(results, baseline, args.threshold)
+
+    text = json.dumps(report, indent=2) + "\n"
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+    for line in regressions:
+        print(f"REGRESSION {line}", file=sys.stderr)
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
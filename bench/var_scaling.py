@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Variable-count scaling benchmark.
+
+Declares N variables, then runs a hot while loop that reads and writes the
+most recently declared ones.  Each N is run with LOOP and with 0 iterations so
+that the reported per-iteration cost excludes declaration and startup time.
+
+Usage: bench/var_scaling.py [--exe ./Project2] [--loop 200000] [--repeat 3]
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+COUNTS = [10, 100, 1000, 10000, 100000]
+
+
+def make_script(num_vars, loop):
+    lines = [f"var v{i} = {i % 7};" for i in range(num_vars)]
+    last = f"v{num_vars - 1}"
+    lines.append("var i = 0;")
+    lines.append(f"while (i < {loop}) {{")
+    lines.append(f"  {last} = {last} + v0;")
+    lines.append("  i = i + 1;")
+    lines.append("}")
+    lines.append(f"print({last});")
+    return "\n".join(lines) + "\n"
+
+
+def best_time(exe, path, repeat):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        subprocess.run([exe, path], check=True, stdout=subprocess.DEVNULL)
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--exe", default="./Project2")
+    parser.add_argument("--loop", type=int, default=200000)
+    parser.add_argument("--repeat", type=int, default=3)
+    args = parser.parse_args()
+
+    if not os.path.exists(args.exe):
+        sys.exit(f"Executable {args.exe} not found; run 'make' first.")
+
+    print(f"{'vars':>8} {'total (s)':>10} {'ns/iter':>10}")
+    with tempfile.TemporaryDirectory() as tmp:
+        for n in COUNTS:
+            hot = os.path.join(tmp, f"hot-{n}.Mc")
+            cold = os.path.join(tmp, f"cold-{n}.Mc")
+            with open(hot, "w") as f:
+                f.write(make_script(n, args.loop))
+            with open(cold, "w") as f:
+                f.write(make_script(n, 0))
+            t_hot = best_time(args.exe, hot, args.repeat)
+            t_cold = best_time(args.exe, cold, args.repeat)
+            per_iter = (t_hot - t_cold) / args.loop * 1e9
+            print(f"{n:>8} {t_hot:>10.4f} {per_iter:>10.1f}")
+
+
+if __name__ == "__main__":
+    main()
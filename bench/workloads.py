@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Generator for parameterized Mc benchmark workloads.
+
+Each workload is a function returning the text of an .Mc script; keyword
+arguments scale it.  Run directly to write the default set to a directory:
+
+Usage: bench/workloads.py OUTDIR [--scale 1.0]
+"""
+
+import argparse
+import os
+
+
+def collatz(starts=30000):
+    """Deep Collatz loops: an inner while loop per start value, like test-36."""
+    return f"""\
+var start = 1;
+var total = 0;
+var longest = 0;
+while (start <= {starts}) {{
+  var n = start;
+  var steps = 0;
+  while (n != 1) {{
+    if (n % 2 == 0) {{
+      n = n / 2;
+    }} else {{
+      n = 3 * n + 1;
+    }}
+    steps = steps + 1;
+  }}
+  total = total + steps;
+  if (steps > longest) {{
+    longest = steps;
+  }}
+  start = start + 1;
+}}
+print("Total steps = {{total}}, longest = {{longest}}");
+"""
+
+
+def scopes(variables=4000, depth=8, loop=2000000):
+    """Thousands of variables spread over nested scopes, read from the innermost one."""
+    per_scope = max(1, variables // depth)
+    lines = ["var i = 0;", "var sum = 0;"]
+    indent = ""
+    for level in range(depth):
+        lines.append(f"{indent}if (1) {{")  # Blocks only nest as statement bodies
+        indent += "  "
+        for k in range(per_scope):
+            lines.append(f"{indent}var d{level}_{k} = {(level * 31 + k) % 97};")
+    reads = " + ".join(f"d{level}_{(level * 7) % per_scope}" for level in range(depth))
+    lines.append(f"{indent}while (i < {loop}) {{")
+    lines.append(f"{indent}  sum = sum + {reads};")
+    lines.append(f"{indent}  d{depth - 1}_0 = d{depth - 1}_0 + 1;")
+    lines.append(f"{indent}  i = i + 1;")
+    lines.append(f"{indent}}}")
+    for _ in range(depth):
+        indent = indent[:-2]
+        lines.append(f"{indent}}}")
+    lines.append("print(sum);")
+    return "\n".join(lines) + "\n"
+
+
+def prints(lines=1000000):
+    """A long stream of interpolated prints."""
+    return f"""\
+var i = 0;
+var half = 0;
+var ratio = 0;
+while (i < {lines}) {{
+  half = i / 2;
+  ratio = i / 7;
+  print("line {{i}}: half={{half}} ratio={{ratio}}");
+  i = i + 1;
+}}
+"""
+
+
+def nested_expr(depth=200, loop=100000):
+    """One deeply parenthesized expression evaluated in a loop."""
+    expr = "x"
+    for level in range(depth):
+        op = "+" if level % 2 == 0 else "-"
+        expr = f"(x {op} {expr} * 0.5)"
+    return f"""\
+var x = 1;
+var y = 0;
+var i = 0;
+while (i < {loop}) {{
+  y = {expr};
+  x = x + 0.001;
+  i = i + 1;
+}}
+print(y);
+"""
+
+
+def straight_line(megabytes=4):
+    """A multi-megabyte script without loops: declarations, updates and prints."""
+    target = int(megabytes * 1024 * 1024)
+    out = ["var acc = 1;"]
+    size = 0
+    i = 0
+    while size < target:
+        if i % 3 == 0:
+            line = f"var s{i} = acc * 3 % 1000 + {i % 17};"
+        elif i % 3 == 1:
+            line = f"acc = acc + s{i - 1} % 13 * 2 - acc / 7;"
+        else:
+            line = f"print(acc);" if i % 30 == 2 else f"acc = (acc + {i % 101}) % 100000;"
+        out.append(line)
+        size += len(line) + 1
+        i += 1
+    out.append("print(acc);")
+    return "\n".join(out) + "\n"
+
+
+# Default suite: name -> (generator, parameters)
+SUITE = {
+    "collatz": (collatz, {"starts": 30000}),
+    "scopes": (scopes, {"variables": 4000, "depth": 8, "loop": 2000000}),
+    "prints": (prints, {"lines": 1000000}),
+    "nested_expr": (nested_expr, {"depth": 200, "loop": 100000}),
+    "straight_line": (straight_line, {"megabytes": 4}),
+}
+
+
+def scaled(params, scale):
+    """Scale every size parameter except nesting depth."""
+    return {key: value if key == "depth" else type(value)(value * scale) or 1
+            for key, value in params.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("outdir")
+    parser.add_argument("--scale", type=float, default=1.0)
+    args = parser.parse_args()
+
+    os.makedirs(args.outdir, exist_ok=True)
+    for name, (generate, params) in SUITE.items():
+        path = os.path.join(args.outdir, f"{name}.Mc")
+        with open(path, "w") as f:
+            f.write(generate(**scaled(params, args.scale)))
+        print(path)
+
+
+if __name__ == "__main__":
+    main()
@@ -3,17 +3,19 @@
 
 #include <algorithm>
 #include <array>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 namespace emplex {
-  // Struct to store information about a found Token
+  // Struct to store information about a found Token.  The lexeme is a view into
+  // the source buffer, which must outlive the token.
   struct Token {
     int id;                             // Type ID for token
-    std::string lexeme;                 // Sequence matched by token
-    size_t line_id;                     // Line token started on
+    std::string_view lexeme;            // Sequence matched by token
     operator int() const { return id; } // Auto-convert tokens to IDs
   };
   
@@ -135,9 +137,7 @@ namespace emplex {
     static constexpr int ERROR_ID = -1;     ///< Code for unknown token ID.
   
     // -- Current State --
-    size_t cur_line = 1;   // Track LINE we are reading in the input.
-    int start_pos = 0;     // Track INDEX for the start of current lexeme.
-    std::string lexeme{};  // Lexeme found for the current token
+    size_t start_pos = 0;  // Track INDEX for the start of current lexeme.
     std::string errors{};  // Description of any errors encountered
   
   public:
@@ -233,10 +233,10 @@ namespace emplex {
     // Generate and return the next token from the input stream.
     Token NextToken(std::string_view in) {
       // If we cannot read in, return an "EOF" token.
-      if (start_pos >= std::ssize(in)) return { 0, "", cur_line };
+      if (start_pos >= in.size()) return { 0, in.substr(in.size()) };
   
-      int cur_pos = start_pos;   // Position in the input that we are actively analyzing
-      int best_pos = start_pos;  // Best look-ahead we've found so far
+      size_t cur_pos = start_pos;   // Position in the input that we are actively analyzing
+      size_t best_pos = start_pos;  // Best look-ahead we've found so far
       int cur_state = 0;         // Next state for the DFA analysis
       int cur_stop = 0;          // Current "stop" state (or 0 if we can't stop here)
       int best_stop = -1;        // Best stop state found so far?
@@ -249,7 +249,7 @@ namespace emplex {
       // 1: We may be able to continue the current lexeme, and
       // 2: We have not entered an invalid state, and
       // 3: Our input string has more symbols to provide
-      while (cur_stop >= 0 && cur_state >= 0 && cur_pos < std::ssize(in)) {
+      while (cur_stop >= 0 && cur_state >= 0 && cur_pos < in.size()) {
         const char next_char = in[cur_pos++];
         if (next_char < 0) break; // Ignore invalid chars.
         cur_state = DFA::GetNext(cur_state, next_char);
@@ -266,21 +266,16 @@ namespace emplex {
       // If we did not find any options, peel off just one character and use it as id.
       if (best_pos == start_pos) { best_stop=in[start_pos]; best_pos++;}
   
-      lexeme = in.substr(start_pos, best_pos-start_pos);
-      start_pos += std::ssize(lexeme);
-  
-      // Update the line number we are on.
-      const size_t out_line = cur_line;
-      cur_line += static_cast<size_t>(std::count(lexeme.begin(),lexeme.end(),'\n'));
+      std::string_view lexeme = in.substr(start_pos, best_pos-start_pos);
+      start_pos = best_pos;
   
       // Return the token we found.
-      return { best_stop, lexeme, out_line };
+      return { best_stop, lexeme };
     }
   
     // Convert an input string into a vector of tokens.
     std::vector<Token> Tokenize(std::string_view in) {
       start_pos = 0; // Start processing at beginning of string.
-      cur_line = 1;  // Start processing at the first line of the input.
       std::vector<Token> out_tokens;
       while (Token token = NextToken(in)) {
         if (!IgnoreToken(token.id)) out_tokens.push_back(token);
@@ -288,11 +283,13 @@ namespace emplex {
       return out_tokens;
     }
   
-    // Convert an input stream to a string, then tokenize.
-    std::vector<Token> Tokenize(std::istream & is) {
-      return Tokenize(
-        std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>())
-      );
+    // Line (starting at 1) on which a token from 'source' starts; computed on demand
+    // since it is only needed for error messages.
+    static size_t LineOf(std::string_view source, const Token & token) {
+      const char * pos = token.lexeme.data();
+      std::less<const char *> before;
+      if (before(pos, source.data()) || before(source.data() + source.size(), pos)) return 0;
+      return 1 + static_cast<size_t>(std::count(source.data(), pos, '\n'));
     }
   };
 } // End of namespace emplex
@@ -0,0 +1,148 @@
+#!/bin/bash
+
+# Run every test program under each engine and optimization setting and compare
+# its output (stdout and stderr) and exit status with the plain tree walker
+# without optimizations, which is the reference semantics, also under a step
+# limit; then check batch mode and daemon mode against running the programs one by one, and runs from the
+# program image cache against parsing them.
+
+configs=(
+    "--engine=tree"
+    "--engine=vm"
+    "--engine=closure"
+    "--engine=vm --no-jit"
+    "--engine=closure --no-jit"
+    "--engine=tree --no-jit"
+    "--engine=vm --no-optimize"
+    "--engine=vm --stream"
+    "--engine=tree --stream --no-jit"
+    "--engine=vm --threads=4"
+    "--engine=closure --no-jit --threads=4"
+)
+
+pass_count=0
+fail_count=0
+
+for code_file in test-*.Mc; do
+    expected=$(../Project2 --engine=tree --no-optimize --no-jit "$code_file" 2>&1; echo "exit $?")
+    for config in "${configs[@]}"; do
+        actual=$(../Project2 $config "$code_file" 2>&1; echo "exit $?")
+        if [ "$expected" == "$actual" ]; then
+            ((pass_count++))
+        else
+            echo "$code_file ... Differs with $config"
+            ((fail_count++))
+        fi
+    done
+done
+
+# Running the tests as one batch (three times over, to keep several workers
+# busy) must print exactly what running them one at a time does, and report the
+# same exit statuses in input order.
+batch_dir=$(mktemp -d)
+batch_files=(test-*.Mc test-*.Mc test-*.Mc)
+for code_file in "${batch_files[@]}"; do
+    ../Project2 "$code_file" >> "$batch_dir/expected" 2>&1
+    printf '%s\t%s\n' $? "$code_file" >> "$batch_dir/expected-status"
+done
+../Project2 --jobs=4 --status="$batch_dir/status" "${batch_files[@]}" > "$batch_dir/actual" 2>&1
+if cmp -s "$batch_dir/expected" "$batch_dir/actual" && cmp -s "$batch_dir/expected-status" "$batch_dir/status"; then
+    ((pass_count++))
+else
+    echo "Batch run ... Differs from running the tests one at a time"
+    ((fail_count++))
+fi
+rm -r "$batch_dir"
+
+# A step limit must stop every engine at the same loop iteration, with the same
+# error and exit status.
+for code_file in test-*.Mc; do
+    expected=$(../Project2 --engine=tree --no-optimize --no-jit --max-steps=3 "$code_file" 2>&1; echo "exit $?")
+    for config in "${configs[@]}"; do
+        actual=$(../Project2 $config --max-steps=3 "$code_file" 2>&1; echo "exit $?")
+        if [ "$expected" == "$actual" ]; then
+            ((pass_count++))
+        else
+            echo "$code_file ... Differs with $config --max-steps=3"
+            ((fail_count++))
+        fi
+    done
+done
+
+# With two NaN operands, + and * give the left one, sign included, in every
+# engine; the compiler is free to swap the operands unless told otherwise.
+nan_program='var b = -4; var a = b ** 0.5; var c = -a;
+print(a * c); print(a + c); print(c * a); print(c + a);
+var i = 0; while (i < 1) { print(a * c); print(c + a); i = i + 1; }'
+expected=$(echo "$nan_program" | ../Project2 --engine=tree --no-optimize --no-jit - 2>&1; echo "exit $?")
+for config in "${configs[@]}" "--engine=closure --no-jit --no-optimize"; do
+    actual=$(echo "$nan_program" | ../Project2 $config - 2>&1; echo "exit $?")
+    if [ "$expected" == "$actual" ]; then
+        ((pass_count++))
+    else
+        echo "Two-NaN arithmetic ... Differs with $config"
+        ((fail_count++))
+    fi
+done
+
+# Output captured in batch mode counts toward --max-memory, so a print loop stops
+# at the memory limit (exit status 3) in every engine.  Where exactly depends on
+# what the program itself takes, which differs when streaming.
+limit_dir=$(mktemp -d)
+printf 'var i = 0;\nwhile (1) { print(i); i = i + 1; }\n' > "$limit_dir/print-loop.Mc"
+for config in "${configs[@]}"; do
+    ../Project2 $config --max-memory=1 --max-seconds=60 --status="$limit_dir/status" "$limit_dir/print-loop.Mc" test-01.Mc \
+        > "$limit_dir/output" 2>&1
+    if grep -q "Memory limit exceeded" "$limit_dir/output" && [ "$(cut -f1 "$limit_dir/status" | tr '\n' ' ')" == "3 0 " ]; then
+        ((pass_count++))
+    else
+        echo "Print loop under --max-memory ... Not stopped by the memory limit with $config"
+        ((fail_count++))
+    fi
+done
+rm -r "$limit_dir"
+
+# A daemon must give the same results, both on a script's first run and when it
+# runs again from the cached program.
+serve_dir=$(mktemp -d)
+../Project2 --serve="$serve_dir/socket" &
+serve_pid=$!
+for attempt in {1..50}; do
+    [ -S "$serve_dir/socket" ] && break
+    sleep 0.1
+done
+for code_file in test-*.Mc; do
+    expected=$(../Project2 "$code_file" 2>&1; echo "exit $?")
+    for run in first cached; do
+        actual=$(../Project2 --connect="$serve_dir/socket" "$code_file" 2>&1; echo "exit $?")
+        if [ "$expected" == "$actual" ]; then
+            ((pass_count++))
+        else
+            echo "$code_file ... Differs when run by the daemon ($run run)"
+            ((fail_count++))
+        fi
+    done
+done
+kill $serve_pid
+wait $serve_pid 2>/dev/null
+rm -r "$serve_dir"
+
+# The first run with the image cache parses the program and writes its image;
+# the second runs from the image.  Runtime errors must still name their token.
+cache_dir=$(mktemp -d)
+for code_file in test-*.Mc; do
+    expected=$(../Project2 "$code_file" 2>&1; echo "exit $?")
+    for run in cold warm; do
+        actual=$(../Project2 --cache-dir="$cache_dir" "$code_file" 2>&1; echo "exit $?")
+        if [ "$expected" == "$actual" ]; then
+            ((pass_count++))
+        else
+            echo "$code_file ... Differs when run with the image cache ($run run)"
+            ((fail_count++))
+        fi
+    done
+done
+rm -r "$cache_dir"
+
+echo "Passed $pass_count of $((pass_count + fail_count)) equivalence checks (Failed $fail_count)"
+exit $fail_count
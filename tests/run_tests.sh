@@ -3,11 +3,11 @@
 # Initialize a counter for differing files
 pass_count=0
 fail_count=0
-test_count=37
+test_count=43
 
 error_pass_count=0
 error_fail_count=0
-error_test_count=16
+error_test_count=19
 
 # Make sure we have directory current/ to put results in.
 if [ ! -d "$DIR" ]; then